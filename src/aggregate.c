@@ -0,0 +1,172 @@
+/*
+ * Group-by aggregates allocation, merging and writing.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aggregate.h"
+
+/* Names of aggregates, in order of selection bits. */
+static const char *agg_names[4] = {"lun", "hour", "bytes", "latency"};
+
+/* Parse a comma separated aggregate list. */
+int
+parseAggMask (const char *spec)
+{
+  int mask = 0;
+
+  while (*spec != '\0')
+    {
+      int len = strcspn (spec, ","), found = 0;
+
+      if (len == 3 && strncmp (spec, "all", 3) == 0)
+        {
+          mask |= AGG_ALL;
+          found = 1;
+        }
+      for (int i = 0; i < 4 && !found; i++)
+        if (strlen (agg_names[i]) == len && strncmp (spec, agg_names[i], len) == 0)
+          {
+            mask |= 1 << i;
+            found = 1;
+          }
+      if (!found)
+        return -1;
+      spec += spec[len] == ',' ? len + 1 : len;
+    }
+
+  return mask;
+}
+
+/* Allocate zeroed accumulators. */
+void
+initAggregate (aggregate *agg, unsigned int mask, unsigned int lun_num, long int hour_base,
+               unsigned int hour_num, unsigned int size_num, const unsigned int *sizes)
+{
+  agg->mask = mask;
+  agg->lun_num = lun_num;
+  agg->hour_base = hour_base;
+  agg->hour_num = hour_num;
+  agg->size_num = size_num;
+  agg->sizes = sizes;
+  agg->lun_cnt = mask & AGG_LUN ? calloc (lun_num, sizeof (long unsigned int)) : NULL;
+  agg->hour_cnt = mask & AGG_HOUR ? calloc (hour_num, sizeof (long unsigned int)) : NULL;
+  agg->size_cnt = mask & AGG_BYTES ? calloc (size_num, sizeof (long unsigned int)) : NULL;
+  agg->hist = mask & AGG_LATENCY ? calloc ((long unsigned int) (size_num + 1) * HIST_BUCKETS,
+                                           sizeof (long unsigned int)) : NULL;
+  agg->resp_max = mask & AGG_LATENCY ? calloc (size_num + 1, sizeof (long unsigned int)) : NULL;
+}
+
+/* Add SRC into DST. */
+void
+mergeAggregate (aggregate *dst, const aggregate *src)
+{
+  if (dst->mask & AGG_LUN)
+    for (unsigned int i = 0; i < dst->lun_num; i++)
+      dst->lun_cnt[i] += src->lun_cnt[i];
+  if (dst->mask & AGG_HOUR)
+    for (unsigned int i = 0; i < dst->hour_num; i++)
+      dst->hour_cnt[i] += src->hour_cnt[i];
+  if (dst->mask & AGG_BYTES)
+    for (unsigned int i = 0; i < dst->size_num; i++)
+      dst->size_cnt[i] += src->size_cnt[i];
+  if (dst->mask & AGG_LATENCY)
+    {
+      for (long unsigned int i = 0; i < (long unsigned int) (dst->size_num + 1) * HIST_BUCKETS; i++)
+        dst->hist[i] += src->hist[i];
+      for (unsigned int i = 0; i <= dst->size_num; i++)
+        if (src->resp_max[i] > dst->resp_max[i])
+          dst->resp_max[i] = src->resp_max[i];
+    }
+}
+
+/* Write one latency row; RESPONSE columns are in seconds like the traces. */
+static void
+writeLatencyRow (const aggregate *agg, FILE *file, unsigned int slot)
+{
+  const long unsigned int *hist = &agg->hist[(long unsigned int) slot * HIST_BUCKETS];
+  long unsigned int total = 0;
+
+  for (int i = 0; i < HIST_BUCKETS; i++)
+    total += hist[i];
+  if (total == 0)
+    return;
+  if (slot == agg->size_num)
+    fprintf (file, "ALL,%lu", total);
+  else
+    fprintf (file, "%u,%lu", agg->sizes[slot], total);
+  fprintf (file, ",%.9f,%.9f,%.9f,%.9f,%.9f\n", histPercentile (hist, total, 0.50) / 1e9,
+                                                histPercentile (hist, total, 0.90) / 1e9,
+                                                histPercentile (hist, total, 0.99) / 1e9,
+                                                histPercentile (hist, total, 0.999) / 1e9,
+                                                agg->resp_max[slot] / 1e9);
+}
+
+/* Write selected sections to a side file. */
+void
+writeAggregate (const aggregate *agg, FILE *file)
+{
+  const char *sep = "";
+
+  if (agg->mask & AGG_LUN)
+    {
+      fprintf (file, "LUN,COUNT\n");
+      for (unsigned int i = 0; i < agg->lun_num; i++)
+        if (agg->lun_cnt[i] > 0)
+          fprintf (file, "%u,%lu\n", i, agg->lun_cnt[i]);
+      sep = "\n";
+    }
+  if (agg->mask & AGG_HOUR)
+    {
+      fprintf (file, "%sHOUR,COUNT\n", sep);
+      for (unsigned int i = 0; i < agg->hour_num; i++)
+        if (agg->hour_cnt[i] > 0)
+          fprintf (file, "%ld,%lu\n", (agg->hour_base + i) * 3600, agg->hour_cnt[i]);
+      sep = "\n";
+    }
+  if (agg->mask & AGG_BYTES)
+    {
+      fprintf (file, "%sSIZE,COUNT,BYTES\n", sep);
+      for (unsigned int i = 0; i < agg->size_num; i++)
+        if (agg->size_cnt[i] > 0)
+          fprintf (file, "%u,%lu,%lu\n", agg->sizes[i], agg->size_cnt[i],
+                                         agg->sizes[i] * agg->size_cnt[i]);
+      sep = "\n";
+    }
+  if (agg->mask & AGG_LATENCY)
+    {
+      fprintf (file, "%sSIZE,COUNT,P50,P90,P99,P999,MAX\n", sep);
+      for (unsigned int i = 0; i <= agg->size_num; i++)
+        writeLatencyRow (agg, file, i);
+    }
+}
+
+/* Release accumulators. */
+void
+freeAggregate (aggregate *agg)
+{
+  free (agg->lun_cnt);
+  free (agg->hour_cnt);
+  free (agg->size_cnt);
+  free (agg->hist);
+  free (agg->resp_max);
+}
+
+/* Value at quantile Q of a histogram. */
+long unsigned int
+histPercentile (const long unsigned int *hist, long unsigned int total, double q)
+{
+  long unsigned int rank = (long unsigned int) (q * total + 0.5), seen = 0;
+
+  if (rank == 0)
+    rank = 1;
+  for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+      seen += hist[i];
+      if (seen >= rank)
+        return histValue (i);
+    }
+  return 0;
+}
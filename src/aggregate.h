@@ -0,0 +1,118 @@
+/*
+ * Group-by aggregates over trace entries, accumulated per thread and merged.
+ *
+ */
+
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include <stdio.h>
+
+/* Aggregate selection bits. */
+#define AGG_LUN 0x1           // Entry count per LUN.
+#define AGG_HOUR 0x2          // Entry count per hour.
+#define AGG_BYTES 0x4         // Entry count and bytes per size.
+#define AGG_LATENCY 0x8       // Response time percentiles per size.
+#define AGG_ALL 0xf
+
+/* Log-bucketed histogram: values below 16 get own buckets, above that every
+ * power of two splits into 8 buckets (relative error under 12.5%). */
+#define HIST_SUB_BITS 3
+#define HIST_BUCKETS (16 + 60 * (1 << HIST_SUB_BITS))
+
+/* Type definitions. */
+typedef struct                    // Type of an aggregate set of one IO type.
+  {
+    unsigned int mask;
+    unsigned int lun_num;
+    long int hour_base;             // First hour, in hours since epoch.
+    unsigned int hour_num;
+    unsigned int size_num;
+    const unsigned int *sizes;      // Size of each size slot, ascending.
+    long unsigned int *lun_cnt;
+    long unsigned int *hour_cnt;
+    long unsigned int *size_cnt;
+    long unsigned int *hist;        // HIST_BUCKETS per size slot, then one for all sizes.
+    long unsigned int *resp_max;
+  } aggregate;
+
+/* Parse a comma separated aggregate list ("lun,hour,bytes,latency" or
+ * "all"); returns the mask, or -1 on an unknown name. */
+int parseAggMask (const char *spec);
+
+/* Allocate zeroed accumulators. */
+void initAggregate (aggregate *agg, unsigned int mask, unsigned int lun_num, long int hour_base,
+                    unsigned int hour_num, unsigned int size_num, const unsigned int *sizes);
+
+/* Add SRC into DST (same shape). */
+void mergeAggregate (aggregate *dst, const aggregate *src);
+
+/* Write selected sections to a side file. */
+void writeAggregate (const aggregate *agg, FILE *file);
+
+/* Release accumulators. */
+void freeAggregate (aggregate *agg);
+
+/* Value (nanoseconds) at quantile Q of a histogram holding TOTAL values. */
+long unsigned int histPercentile (const long unsigned int *hist, long unsigned int total,
+                                  double q);
+
+/* Histogram bucket of a value. */
+static inline unsigned int
+histBucket (long unsigned int value)
+{
+  int exp;
+
+  if (value < 16)
+    return value;
+  exp = 63 - __builtin_clzl (value);
+  return 16 + ((exp - 4) << HIST_SUB_BITS)
+            + ((value >> (exp - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1));
+}
+
+/* Representative (middle) value of a histogram bucket. */
+static inline long unsigned int
+histValue (unsigned int bucket)
+{
+  int exp, sub;
+  long unsigned int low;
+
+  if (bucket < 16)
+    return bucket;
+  exp = ((bucket - 16) >> HIST_SUB_BITS) + 4;
+  sub = (bucket - 16) & ((1 << HIST_SUB_BITS) - 1);
+  low = (long unsigned int) ((1 << HIST_SUB_BITS) + sub) << (exp - HIST_SUB_BITS);
+  return low + (1UL << (exp - HIST_SUB_BITS)) / 2;
+}
+
+/* Account one entry; SIZE_SLOT indexes `sizes', RESPONSE is in nanoseconds
+ * or negative when the trace leaves it empty. */
+static inline void
+accumulate (aggregate *agg, unsigned int lun, double time_stamp, unsigned int size_slot,
+            long int response)
+{
+  if (agg->mask & AGG_LUN && lun < agg->lun_num)
+    agg->lun_cnt[lun]++;
+  if (agg->mask & AGG_HOUR)
+    {
+      long int hour = (long int) (time_stamp / 3600) - agg->hour_base;
+
+      if (hour >= 0 && hour < agg->hour_num)
+        agg->hour_cnt[hour]++;
+    }
+  if (agg->mask & AGG_BYTES)
+    agg->size_cnt[size_slot]++;
+  if (agg->mask & AGG_LATENCY && response >= 0)
+    {
+      unsigned int bucket = histBucket (response);
+
+      agg->hist[(long unsigned int) size_slot * HIST_BUCKETS + bucket]++;
+      agg->hist[(long unsigned int) agg->size_num * HIST_BUCKETS + bucket]++;
+      if ((long unsigned int) response > agg->resp_max[size_slot])
+        agg->resp_max[size_slot] = response;
+      if ((long unsigned int) response > agg->resp_max[agg->size_num])
+        agg->resp_max[agg->size_num] = response;
+    }
+}
+
+#endif
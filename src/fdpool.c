@@ -0,0 +1,143 @@
+/*
+ * Bounded pool of read-only source file descriptors.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "fdpool.h"
+
+#define FD_RESERVED 64        // Descriptors left for outputs and stdio.
+
+static void unlinkIdle (fd_pool *pool, unsigned int file_idx);
+
+/* Create a pool over named files. */
+fd_pool *
+newFdPool (char **names, unsigned int file_num, unsigned int cap)
+{
+  fd_pool *pool = malloc (sizeof (fd_pool));
+
+  pool->names = names;
+  pool->file_num = file_num;
+  pool->cap = cap;
+  pool->open_num = 0;
+  pool->pinned = file_num <= cap;
+  pool->lru_head = pool->lru_tail = -1;
+  pool->slots = malloc (sizeof (fd_slot) * file_num);
+  pthread_mutex_init (&pool->lock, NULL);
+
+  for (unsigned int i = 0; i < file_num; i++)
+    {
+      pool->slots[i].fd = pool->pinned && names[i] != NULL ? open (names[i], O_RDONLY) : -1;
+      pool->slots[i].refs = 0;
+      pool->slots[i].lru_prev = pool->slots[i].lru_next = -1;
+    }
+  if (pool->pinned)
+    pool->open_num = file_num;
+
+  return pool;
+}
+
+/* Get a descriptor of a file. */
+int
+acquireFd (fd_pool *pool, unsigned int file_idx)
+{
+  fd_slot *slot = &pool->slots[file_idx];
+  int fd;
+
+  if (pool->pinned)
+    return slot->fd;
+
+  pthread_mutex_lock (&pool->lock);
+  if (slot->fd >= 0)
+    {
+      if (slot->refs++ == 0)
+        unlinkIdle (pool, file_idx);
+    }
+  else
+    {
+      /* Make room by closing the least recently used idle descriptor. */
+      if (pool->open_num >= pool->cap && pool->lru_head >= 0)
+        {
+          long int victim = pool->lru_head;
+
+          unlinkIdle (pool, victim);
+          close (pool->slots[victim].fd);
+          pool->slots[victim].fd = -1;
+          pool->open_num--;
+        }
+      slot->fd = open (pool->names[file_idx], O_RDONLY);
+      slot->refs = 1;
+      pool->open_num++;
+    }
+  fd = slot->fd;
+  pthread_mutex_unlock (&pool->lock);
+
+  return fd;
+}
+
+/* Done reading a file for now. */
+void
+releaseFd (fd_pool *pool, unsigned int file_idx)
+{
+  fd_slot *slot = &pool->slots[file_idx];
+
+  if (pool->pinned)
+    return;
+
+  pthread_mutex_lock (&pool->lock);
+  if (--slot->refs == 0)    // Append to idle list as most recently used.
+    {
+      slot->lru_prev = pool->lru_tail;
+      slot->lru_next = -1;
+      if (pool->lru_tail >= 0)
+        pool->slots[pool->lru_tail].lru_next = file_idx;
+      else
+        pool->lru_head = file_idx;
+      pool->lru_tail = file_idx;
+    }
+  pthread_mutex_unlock (&pool->lock);
+}
+
+/* Close every descriptor and release the pool. */
+void
+freeFdPool (fd_pool *pool)
+{
+  for (unsigned int i = 0; i < pool->file_num; i++)
+    if (pool->slots[i].fd >= 0)
+      close (pool->slots[i].fd);
+  pthread_mutex_destroy (&pool->lock);
+  free (pool->slots);
+  free (pool);
+}
+
+/* Pool capacity allowed by the process descriptor limit. */
+unsigned int
+fdPoolLimit (void)
+{
+  struct rlimit rlim;
+
+  if (getrlimit (RLIMIT_NOFILE, &rlim) != 0 || rlim.rlim_cur == RLIM_INFINITY)
+    return 1024;
+  return rlim.rlim_cur > 2 * FD_RESERVED ? rlim.rlim_cur - FD_RESERVED : rlim.rlim_cur / 2;
+}
+
+/* Auxiliary function for taking a slot out of the idle list. */
+static void
+unlinkIdle (fd_pool *pool, unsigned int file_idx)
+{
+  fd_slot *slot = &pool->slots[file_idx];
+
+  if (slot->lru_prev >= 0)
+    pool->slots[slot->lru_prev].lru_next = slot->lru_next;
+  else
+    pool->lru_head = slot->lru_next;
+  if (slot->lru_next >= 0)
+    pool->slots[slot->lru_next].lru_prev = slot->lru_prev;
+  else
+    pool->lru_tail = slot->lru_prev;
+  slot->lru_prev = slot->lru_next = -1;
+}
@@ -0,0 +1,47 @@
+/*
+ * Bounded pool of read-only source file descriptors shared across threads.
+ *
+ */
+
+#ifndef FDPOOL_H
+#define FDPOOL_H
+
+#include <pthread.h>
+
+/* Type definitions. */
+typedef struct                    // Type of a pooled file slot.
+  {
+    int fd;                         // -1 while closed.
+    unsigned int refs;              // Threads currently reading it.
+    long int lru_prev, lru_next;    // Links in the idle list, -1 terminated.
+  } fd_slot;
+typedef struct                    // Type of a file descriptor pool.
+  {
+    char **names;
+    unsigned int file_num;
+    unsigned int cap;               // Max descriptors open at once.
+    unsigned int open_num;
+    int pinned;                     // All files fit: opened once, no locking.
+    long int lru_head, lru_tail;    // Idle open slots, least recently used at head.
+    fd_slot *slots;
+    pthread_mutex_t lock;
+  } fd_pool;
+
+/* Create a pool over FILE_NUM named files keeping at most CAP descriptors
+ * open; CAP must exceed the number of threads holding one at a time. */
+fd_pool *newFdPool (char **names, unsigned int file_num, unsigned int cap);
+
+/* Get a descriptor of file FILE_IDX, opening it (and closing the least
+ * recently used idle one) if needed; pair with releaseFd. Use with pread. */
+int acquireFd (fd_pool *pool, unsigned int file_idx);
+
+/* Done reading file FILE_IDX for now. */
+void releaseFd (fd_pool *pool, unsigned int file_idx);
+
+/* Close every descriptor and release the pool. */
+void freeFdPool (fd_pool *pool);
+
+/* Pool capacity allowed by the process descriptor limit. */
+unsigned int fdPoolLimit (void);
+
+#endif
@@ -0,0 +1,171 @@
+/*
+ * Seekable gzip output compression, frame index writing and range inflating.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "gzframe.h"
+
+#define GZIP_WINDOW_BITS (15 + 16)    // Deflate window with gzip wrapper.
+
+/* Compress RAW into a new frame appended to ST. */
+void
+gzFrame (gz_stream *st, const char *raw, long unsigned int raw_len,
+         long unsigned int raw_off, int level)
+{
+  z_stream zs = {0};
+  long unsigned int bound;
+  gz_frame *frame;
+
+  if (raw_len == 0)
+    return;
+
+  /* Make room for the worst case of this frame. */
+  deflateInit2 (&zs, level, Z_DEFLATED, GZIP_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY);
+  bound = deflateBound (&zs, raw_len);
+  if (st->len + bound > st->cap)
+    {
+      st->cap = (st->len + bound) * 2;
+      st->data = realloc (st->data, st->cap);
+    }
+  if (st->frame_num == st->frame_cap)
+    {
+      st->frame_cap = st->frame_cap ? st->frame_cap * 2 : 64;
+      st->frames = realloc (st->frames, sizeof (gz_frame) * st->frame_cap);
+    }
+
+  /* One complete gzip member per frame. */
+  zs.next_in = (unsigned char *) raw;
+  zs.avail_in = raw_len;
+  zs.next_out = (unsigned char *) st->data + st->len;
+  zs.avail_out = bound;
+  deflate (&zs, Z_FINISH);
+
+  frame = &st->frames[st->frame_num++];
+  frame->raw_off = raw_off;
+  frame->raw_len = raw_len;
+  frame->gz_off = st->len;
+  frame->gz_len = zs.total_out;
+  st->len += zs.total_out;
+  deflateEnd (&zs);
+}
+
+/* Release a stream. */
+void
+freeGzStream (gz_stream *st)
+{
+  free (st->data);
+  free (st->frames);
+  memset (st, 0, sizeof (gz_stream));
+}
+
+/* Write the frame index of streams laid out back to back in order. */
+void
+writeFrameIndex (FILE *frames_file, const gz_stream *streams, int stream_num)
+{
+  long unsigned int frame_num = 0, base = 0;
+
+  for (int i = 0; i < stream_num; i++)
+    frame_num += streams[i].frame_num;
+  fprintf (frames_file, "FRAMES,%lu\n", frame_num);
+
+  for (int i = 0; i < stream_num; i++)
+    {
+      for (unsigned int j = 0; j < streams[i].frame_num; j++)
+        {
+          const gz_frame *frame = &streams[i].frames[j];
+
+          fprintf (frames_file, "%lu,%lu,%lu,%lu\n", frame->raw_off, frame->raw_len,
+                                                     base + frame->gz_off, frame->gz_len);
+        }
+      base += streams[i].len;
+    }
+}
+
+/* Load a frame index. */
+long int
+loadFrameIndex (const char *frames_name, gz_frame **frames)
+{
+  FILE *frames_file = fopen (frames_name, "r");
+  long int frame_num;
+
+  if (frames_file == NULL)
+    return -1;
+  if (fscanf (frames_file, "FRAMES,%ld\n", &frame_num) != 1 || frame_num < 0)
+    {
+      fclose (frames_file);
+      return -1;
+    }
+
+  *frames = malloc (sizeof (gz_frame) * (frame_num + 1));
+  for (long int i = 0; i < frame_num; i++)
+    if (fscanf (frames_file, "%lu,%lu,%lu,%lu\n", &(*frames)[i].raw_off, &(*frames)[i].raw_len,
+                &(*frames)[i].gz_off, &(*frames)[i].gz_len) != 4)
+      {
+        free (*frames);
+        fclose (frames_file);
+        return -1;
+      }
+
+  fclose (frames_file);
+  return frame_num;
+}
+
+/* Inflate a raw byte range, touching only the covering frames. */
+char *
+inflateRange (FILE *gz_file, const gz_frame *frames, long int frame_num,
+              long unsigned int raw_start, long unsigned int raw_end)
+{
+  char *out = malloc (raw_end > raw_start ? raw_end - raw_start : 1);
+  long int first = 0;
+
+  /* Binary search the frame holding RAW_START (frames are in raw order). */
+  for (long int lo = 0, hi = frame_num - 1; lo <= hi;)
+    {
+      long int mid = lo + (hi - lo) / 2;
+
+      if (frames[mid].raw_off <= raw_start)
+        {
+          first = mid;
+          lo = mid + 1;
+        }
+      else
+        hi = mid - 1;
+    }
+
+  for (long int i = first; i < frame_num && frames[i].raw_off < raw_end; i++)
+    {
+      const gz_frame *frame = &frames[i];
+      char *gz = malloc (frame->gz_len), *raw = malloc (frame->raw_len);
+      long unsigned int from, to;
+      z_stream zs = {0};
+
+      /* Inflate the whole member, keep the overlapping part. */
+      fseek (gz_file, frame->gz_off, SEEK_SET);
+      if (fread (gz, 1, frame->gz_len, gz_file) != frame->gz_len)
+        {
+          free (gz);
+          free (raw);
+          free (out);
+          return NULL;
+        }
+      inflateInit2 (&zs, GZIP_WINDOW_BITS);
+      zs.next_in = (unsigned char *) gz;
+      zs.avail_in = frame->gz_len;
+      zs.next_out = (unsigned char *) raw;
+      zs.avail_out = frame->raw_len;
+      inflate (&zs, Z_FINISH);
+      inflateEnd (&zs);
+
+      from = raw_start > frame->raw_off ? raw_start : frame->raw_off;
+      to = raw_end < frame->raw_off + frame->raw_len ? raw_end : frame->raw_off + frame->raw_len;
+      memcpy (out + (from - raw_start), raw + (from - frame->raw_off), to - from);
+      free (gz);
+      free (raw);
+    }
+
+  return out;
+}
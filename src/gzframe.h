@@ -0,0 +1,52 @@
+/*
+ * Seekable gzip output: independent gzip members (frames) plus a frame index.
+ *
+ */
+
+#ifndef GZFRAME_H
+#define GZFRAME_H
+
+#include <stdio.h>
+
+/* Frame index layout (`<result>.gz.frames' beside each compressed result):
+ *   FRAMES,<frames>
+ *   <raw offset>,<raw bytes>,<gz offset>,<gz bytes>
+ * Concatenated gzip members form one valid gzip stream, so the result still
+ * decompresses with plain `gunzip', while readers holding the index can
+ * inflate only the frames covering a raw byte range. */
+
+/* Type definitions. */
+typedef struct                    // Type of a compressed frame.
+  {
+    long unsigned int raw_off;
+    long unsigned int raw_len;
+    long unsigned int gz_off;       // Relative to the owning stream until placed.
+    long unsigned int gz_len;
+  } gz_frame;
+typedef struct                    // Type of an in-memory compressed stream.
+  {
+    char *data;
+    long unsigned int len, cap;
+    gz_frame *frames;
+    unsigned int frame_num, frame_cap;
+  } gz_stream;
+
+/* Compress RAW into a new frame appended to ST. */
+void gzFrame (gz_stream *st, const char *raw, long unsigned int raw_len,
+              long unsigned int raw_off, int level);
+
+/* Release a stream (frames and data). */
+void freeGzStream (gz_stream *st);
+
+/* Write the frame index of streams laid out back to back in order. */
+void writeFrameIndex (FILE *frames_file, const gz_stream *streams, int stream_num);
+
+/* Load a frame index; returns the number of frames or -1. */
+long int loadFrameIndex (const char *frames_name, gz_frame **frames);
+
+/* Inflate raw bytes [RAW_START, RAW_END) of a compressed result, touching
+ * only the covering frames; returns a malloc'ed buffer or NULL. */
+char *inflateRange (FILE *gz_file, const gz_frame *frames, long int frame_num,
+                    long unsigned int raw_start, long unsigned int raw_end);
+
+#endif
@@ -0,0 +1,123 @@
+/*
+ * Sparse size / time index loading and range resolving.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "index.h"
+
+#define LINE_LENGTH_MAX 120   // Max length of an index line.
+
+/* Load index file. */
+size_index *
+loadIndex (const char *idx_name)
+{
+  FILE *idx_file = fopen (idx_name, "r");
+  char line[LINE_LENGTH_MAX];
+  long unsigned int run_cap = 64, ckpt_cap = 256;
+  size_index *idx;
+
+  if (idx_file == NULL)
+    return NULL;
+  idx = calloc (1, sizeof (size_index));
+  idx->runs = malloc (sizeof (size_run) * run_cap);
+  idx->ckpts = malloc (sizeof (checkpoint) * ckpt_cap);
+
+  /* Head line. */
+  if (fgets (line, LINE_LENGTH_MAX, idx_file) == NULL
+      || sscanf (line, "INDEX,%lu,%u", &idx->entries, &idx->stride) != 2)
+    {
+      fclose (idx_file);
+      freeIndex (idx);
+      return NULL;
+    }
+
+  /* Size runs, each followed by its checkpoints. */
+  while (fgets (line, LINE_LENGTH_MAX, idx_file) != NULL)
+    {
+      if (line[0] == 'S')
+        {
+          size_run *run;
+
+          if (idx->run_num == run_cap)
+            idx->runs = realloc (idx->runs, sizeof (size_run) * (run_cap *= 2));
+          run = &idx->runs[idx->run_num++];
+          sscanf (line, "S,%u,%lu,%lu,%lu,%lu", &run->size, &run->first_entry,
+                  &run->entries, &run->byte_start, &run->byte_end);
+          run->ckpt_start = idx->ckpt_num;
+          run->ckpt_num = 0;
+        }
+      else if (line[0] == 'T' && idx->run_num > 0)
+        {
+          checkpoint *ckpt;
+
+          if (idx->ckpt_num == ckpt_cap)
+            idx->ckpts = realloc (idx->ckpts, sizeof (checkpoint) * (ckpt_cap *= 2));
+          ckpt = &idx->ckpts[idx->ckpt_num++];
+          sscanf (line, "T,%lf,%lu,%lu", &ckpt->time_stamp, &ckpt->entry, &ckpt->byte);
+          idx->runs[idx->run_num - 1].ckpt_num++;
+        }
+    }
+
+  fclose (idx_file);
+  return idx;
+}
+
+/* Release a loaded index. */
+void
+freeIndex (size_index *idx)
+{
+  if (idx == NULL)
+    return;
+  free (idx->runs);
+  free (idx->ckpts);
+  free (idx);
+}
+
+/* Resolve the byte range for a size and a time window. */
+int
+seekRange (const size_index *idx, unsigned int size, double from, double to,
+           byte_range *range)
+{
+  long unsigned int lo = 0, hi = idx->run_num;
+  const size_run *run;
+  const checkpoint *ckpts;
+
+  /* Binary search the size run (runs are in ascending order of sizes). */
+  while (lo < hi)
+    {
+      long unsigned int mid = lo + (hi - lo) / 2;
+
+      if (idx->runs[mid].size < size)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  if (lo == idx->run_num || idx->runs[lo].size != size)
+    return -1;
+  run = &idx->runs[lo];
+  ckpts = &idx->ckpts[run->ckpt_start];
+
+  /* Whole run unless narrowed by checkpoints below. */
+  range->first_entry = run->first_entry;
+  range->byte_start = run->byte_start;
+  range->byte_end = run->byte_end;
+
+  /* Start from the last checkpoint strictly before FROM. */
+  for (long unsigned int i = 1; i < run->ckpt_num && ckpts[i].time_stamp < from; i++)
+    {
+      range->first_entry = ckpts[i].entry;
+      range->byte_start = ckpts[i].byte;
+    }
+
+  /* Stop at the first checkpoint strictly after TO. */
+  for (long unsigned int i = 1; i < run->ckpt_num; i++)
+    if (ckpts[i].time_stamp > to)
+      {
+        range->byte_end = ckpts[i].byte;
+        break;
+      }
+
+  return 0;
+}
@@ -0,0 +1,64 @@
+/*
+ * Sparse size / time index over sorted result files (R.csv, W.csv).
+ *
+ */
+
+#ifndef INDEX_H
+#define INDEX_H
+
+/* Index file layout (one `<result>.idx' beside each result file):
+ *   INDEX,<entries>,<stride>
+ *   S,<size>,<first entry>,<entries>,<byte start>,<byte end>
+ *   T,<time stamp>,<entry>,<byte start>     (every <stride> entries of the run above)
+ * Entries are numbered from 1 (the line after the instruction line), byte
+ * ranges are half-open and count from the head of the result file. */
+
+#define INDEX_STRIDE 4096     // Entries between two time checkpoints of a size run.
+
+/* Type definitions. */
+typedef struct                    // Type of a time checkpoint.
+  {
+    double time_stamp;
+    long unsigned int entry;
+    long unsigned int byte;
+  } checkpoint;
+typedef struct                    // Type of a size run.
+  {
+    unsigned int size;
+    long unsigned int first_entry;
+    long unsigned int entries;
+    long unsigned int byte_start;
+    long unsigned int byte_end;
+    long unsigned int ckpt_start;   // First checkpoint of this run.
+    long unsigned int ckpt_num;     // Number of checkpoints of this run.
+  } size_run;
+typedef struct                    // Type of a loaded index.
+  {
+    long unsigned int entries;
+    unsigned int stride;
+    long unsigned int run_num;
+    long unsigned int ckpt_num;
+    size_run *runs;
+    checkpoint *ckpts;
+  } size_index;
+typedef struct                    // Type of a resolved byte range.
+  {
+    long unsigned int first_entry;
+    long unsigned int byte_start;
+    long unsigned int byte_end;
+  } byte_range;
+
+/* Load index file; returns NULL if missing or malformed. */
+size_index *loadIndex (const char *idx_name);
+
+/* Release a loaded index. */
+void freeIndex (size_index *idx);
+
+/* Resolve the byte range that covers all entries of SIZE with time stamps
+ * in [FROM, TO]; returns 0 on success, -1 if the size does not occur. The
+ * range may hold a few entries outside [FROM, TO] at both ends (at most
+ * one stride), so callers filter by time stamp while scanning. */
+int seekRange (const size_index *idx, unsigned int size, double from, double to,
+               byte_range *range);
+
+#endif
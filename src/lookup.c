@@ -0,0 +1,111 @@
+/*
+ * Result files (R.csv, W.csv) lookup by size and time window, through index.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include "index.h"
+#include "gzframe.h"
+#include "tracesort.h"
+
+#define NAME_LENGTH_MAX 256   // Max length of a file name.
+
+/* Print entries of one size (optionally in a time window) from a result file. */
+int
+main (int argc, char *argv[])
+{
+  char idx_name[NAME_LENGTH_MAX], line[TS_LINE_MAX + 1], *raw = NULL;
+  double from = -DBL_MAX, to = DBL_MAX;
+  long unsigned int hit_cnt = 0, limit;
+  size_t name_len;
+  unsigned int size;
+  size_index *idx;
+  byte_range range;
+  FILE *res_file;
+
+  if (argc != 3 && argc != 5)
+    {
+      fprintf (stderr, "Usage: %s <result.csv> <size> [<from> <to>]\n", argv[0]);
+      return 1;
+    }
+  name_len = strlen (argv[1]);
+  size = strtoul (argv[2], NULL, 10);
+  if (argc == 5)
+    {
+      from = strtod (argv[3], NULL);
+      to = strtod (argv[4], NULL);
+    }
+
+  /* Load index beside the result file. */
+  snprintf (idx_name, NAME_LENGTH_MAX, "%s.idx", argv[1]);
+  if ((idx = loadIndex (idx_name)) == NULL)
+    {
+      fprintf (stderr, " Cannot load index %s !\n", idx_name);
+      return 1;
+    }
+  if (seekRange (idx, size, from, to, &range) != 0)
+    {
+      fprintf (stderr, " Size %u does not occur in %s.\n", size, argv[1]);
+      freeIndex (idx);
+      return 0;
+    }
+
+  /* Seek straight to the range; compressed results inflate only the covering frames. */
+  if (name_len > 3 && strcmp (argv[1] + name_len - 3, ".gz") == 0)
+    {
+      char frames_name[NAME_LENGTH_MAX];
+      gz_frame *frames;
+      long int frame_num;
+      FILE *gz_file = fopen (argv[1], "r");
+
+      snprintf (frames_name, NAME_LENGTH_MAX, "%s.frames", argv[1]);
+      if (gz_file == NULL || (frame_num = loadFrameIndex (frames_name, &frames)) < 0)
+        {
+          fprintf (stderr, " Cannot load frame index %s !\n", frames_name);
+          freeIndex (idx);
+          return 1;
+        }
+      raw = inflateRange (gz_file, frames, frame_num, range.byte_start, range.byte_end);
+      fclose (gz_file);
+      free (frames);
+      if (raw == NULL)
+        {
+          fprintf (stderr, " Cannot inflate %s !\n", argv[1]);
+          freeIndex (idx);
+          return 1;
+        }
+      limit = range.byte_end - range.byte_start;
+      res_file = fmemopen (raw, limit, "r");
+    }
+  else
+    {
+      res_file = fopen (argv[1], "r");
+      fseek (res_file, range.byte_start, SEEK_SET);
+      limit = range.byte_end;
+    }
+
+  /* Filter by time stamp. */
+  while (ftell (res_file) < (long) limit
+         && fgets (line, TS_LINE_MAX + 1, res_file) != NULL)
+    {
+      double time_stamp = strtod (line, NULL);
+
+      if (time_stamp > to)
+        break;
+      if (time_stamp >= from)
+        {
+          fputs (line, stdout);
+          hit_cnt++;
+        }
+    }
+  fprintf (stderr, " %lu entries of size %u, bytes [%lu, %lu).\n", hit_cnt, size,
+           range.byte_start, range.byte_end);
+
+  fclose (res_file);
+  free (raw);
+  freeIndex (idx);
+  return 0;
+}
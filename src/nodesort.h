@@ -0,0 +1,96 @@
+/*
+ * Node selection and heap sort, instantiated once per sort key: tracesort.c
+ * defines NODE_SORT (a name suffix) and NODE_LARGER (a, b, keys) before each
+ * inclusion, so every instance has its comparator inlined.
+ *
+ */
+
+#ifndef NODE_CAT
+#define NODE_CAT(a, b) NODE_CAT2 (a, b)
+#define NODE_CAT2(a, b) a##b
+#endif
+#define NODE_FN(name) NODE_CAT (name, NODE_SORT)
+
+/* Partially order ARR[LO, HI] so that the K-th smallest node sits at K, with no
+   larger node before it and no smaller one after it (Hoare partitioning around
+   a median of three). */
+static void
+NODE_FN (selectNodes) (node *arr, long unsigned int lo, long unsigned int hi,
+                       long unsigned int k, const int *keys)
+{
+  while (lo < hi)
+    {
+      long unsigned int mid = lo + (hi - lo) / 2, i = lo, j = hi;
+      node pivot;
+
+      /* Median of three to the middle, guarding both scans. */
+      if (NODE_LARGER (&arr[lo], &arr[mid], keys))
+        swap (&arr[lo], &arr[mid]);
+      if (NODE_LARGER (&arr[mid], &arr[hi], keys))
+        swap (&arr[mid], &arr[hi]);
+      if (NODE_LARGER (&arr[lo], &arr[mid], keys))
+        swap (&arr[lo], &arr[mid]);
+      pivot = arr[mid];
+
+      while (i <= j)
+        {
+          while (NODE_LARGER (&pivot, &arr[i], keys))
+            i++;
+          while (NODE_LARGER (&arr[j], &pivot, keys))
+            j--;
+          if (i <= j)
+            swap (&arr[i++], &arr[j--]);
+        }
+
+      /* Continue in the side holding K. */
+      if (k <= j)
+        hi = j;
+      else if (k >= i)
+        lo = i;
+      else
+        break;
+    }
+}
+
+/* Sift ARR[PIVOT] down a heap of LEN nodes. */
+static void
+NODE_FN (heapify) (node *arr, long unsigned int len, long unsigned int pivot, const int *keys)
+{
+  while (1)
+    {
+      long unsigned int left = 2 * pivot;
+      long unsigned int right = 2 * pivot + 1;
+      long unsigned int largest = (left <= len && NODE_LARGER (&arr[left], &arr[pivot], keys))
+                                  ? left : pivot;
+
+      if (right <= len && NODE_LARGER (&arr[right], &arr[largest], keys))
+        largest = right;
+      if (largest == pivot)
+        break;
+      swap (&arr[pivot], &arr[largest]);
+      pivot = largest;
+    }
+}
+
+/* Heap-sort ARR[1, NUM] in ascending order. */
+static void
+NODE_FN (heapSort) (node *arr, long unsigned int num, const int *keys)
+{
+  long unsigned int heap_size = num;
+
+  /* Build heap by Floyd. */
+  for (long unsigned int i = num / 2 + 1; i > 0; i--)
+    NODE_FN (heapify) (arr, heap_size, i, keys);
+
+  /* Iteratively extract heap top and place at tail. */
+  for (long unsigned int i = num; i > 1; i--)
+    {
+      swap (&arr[1], &arr[i]);
+      heap_size--;
+      NODE_FN (heapify) (arr, heap_size, 1, keys);
+    }
+}
+
+#undef NODE_FN
+#undef NODE_SORT
+#undef NODE_LARGER
@@ -8,41 +8,57 @@
 #include <string.h>
 #include <unistd.h>
 #include <wait.h>
+#include <glob.h>
+#include <signal.h>
 #include <omp.h>
+#include <pthread.h>
 #include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "aggregate.h"
+#include "tracesort.h"
+#include "tune.h"
 
 #pragma GCC diagnostic ignored "-Wunused-result"  // Shutdown unused warnings for `fscanf'.
 
 /* Predefined constants. */
-#define NAME_LENGTH_MAX 35    // Max length of command component.
-#define LINE_LENGTH_MAX 60    // Max length of an entry line.
-#define R_IDX 0               // File index of R.csv.
-#define W_IDX 1               // File index of W.csv.
-#define FILE_NUM 32           // Number of source files.
-#define INST_LINE_LENGTH 42   // Length of first line (Timestamp,...).
-#define SIZE_MAX 600000       // Upper bound of size.
-
-/* Scanned statistics. */
-static long unsigned int NUM_ARR[2][FILE_NUM] = {0};  // Number of entries in each source file.
-static long unsigned int NUM[2] = {0};                // Number of entries of read / write.
-static unsigned int CNT[2] = {0};                     // Number of different sizes of read / write.
-static unsigned int NUM_THREADS;                      // Parallel degree of OpenMP.
+#define NAME_LENGTH_MAX 256   // Max length of command component.
+#define BATCH_AHEAD 1         // Archives unpacked ahead of the one being sorted.
+
+/* Run options. */
+static int AGG_MASK = 0;                              // Selected aggregates (`-a').
+static char *INPUT_DIR = "input";                     // Directory of source files (`-i').
+static char *MANIFEST = NULL;                         // List of source files (`-m').
+static int GZIP_LEVEL = 0;                            // Seekable gzip results (`-z').
+static unsigned int SIZE_LO = 0, SIZE_HI = 0;        // Queried size range (`-s').
+static long int TOP_K = 0;                            // Queried top-K entries (`-k', `-K').
+static unsigned int SHARDS = 0;                       // Shards per IO type (`-n').
+static double TS_FROM = 0, TS_TO = 0;                 // Time stamp window (`-t').
+static long unsigned int LUN_MASK = 0;                // Selected LUNs (`-l').
+static int IO_TYPES = 0;                              // Selected IO types (`-y').
+static int VIEWS = 0;                                 // Extra sort views (`-v').
+static double REUSE_RATE = 0;                         // Reuse distance sampling (`-r').
+static ts_schema SCHEMA;                              // Layout of source lines (`-F').
+static int SORT_KEY[TS_KEYS];                         // Sort key (`-S').
+static int STREAM_MODE = -1;                          // IO type streamed out (`-c').
+static char *STREAM_SOCKET = NULL;                    // Unix socket streamed to (`-c').
+static int BATCH = 0;                                 // Archives as arguments (`-b').
+static ts_options DEGREES;                            // Parallel degrees (`-j', TS_THREADS).
+static FILE *LOG_FILE;                                // Where stage timings go.
 
 /* Type definitions. */
 typedef void (*PROCESS) (void);   // Type of process handler function.
-typedef struct                    // Type of an entry node.
+typedef struct                    // Type of a batch job, one archive.
   {
-    unsigned int size;
-    double time_stamp;
-    int src_file_idx;
-    long unsigned int offset;
-    long unsigned int write_offset;
-  } node;
-typedef struct                    // Type of size count slot.
-  {
-    unsigned int size;
-    long unsigned int cnt; 
-  } cnt_struct;
+    char *archive;                  // Tar archive, or directory of traces.
+    int is_dir;
+    char in_dir[NAME_LENGTH_MAX];   // Where its traces are unpacked.
+    char out_dir[NAME_LENGTH_MAX];
+    struct timeval unpack_start, unpack_end;
+    tune_phase unzip;               // Unzipping degree it got.
+    int unpacked;
+  } batch_job;
 
 /* Subroutine definitions. */
 void decompress (void);
@@ -50,332 +66,525 @@ void scanStatistics (void);
 void abstractRead (void);
 void sortEntries (void);
 void writeResult (void);
+static void unpackInputs (const char *tar_file, const char *dir);
+static unsigned int discoverInputs (const char *dir);
+static int runBatch (int num, char **archives);
+static void *unpackJobs (void *arg);
 static void runProcess (char *name, PROCESS func);
-static void heapify (node *arr, long unsigned int len, long unsigned int pivot);
-static inline void swap (node *a, node *b);
-static inline int larger (node *a, node *b);
+static void logTime (char *name, const struct timeval *tv_start, const struct timeval *tv_end);
+static void reportPhases (const tune_phase *unzip);
+static void reportLongLines (void);
 
 /* Global variables or containers. */
-static unsigned int LUN_idx_arr[6] = {0, 1, 2, 3, 4, 6};  // LUN indexes.
-static FILE *global_src_file[FILE_NUM];                   // Source file pointers.
-static cnt_struct *size_cnt_arr[2];                       // Array of size count data.
-static node *node_arr[2];                                 // Huge node arrays.
+static ts_options opts;                                   // Options of the run.
+static ts_ctx *ctx;                                       // Sorting context of the run.
+static tune_phase unzip_tune;                             // Parallel degree of unzipping.
+static int write_failed;                                  // Results missing or cut short.
+static const char *out_dir = "output";                    // Directory results go to.
+static batch_job *job_arr;                                // Jobs of a batch.
+static unsigned int job_num, job_done;
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_cond = PTHREAD_COND_INITIALIZER;  // A job unpacked or done.
 
 /* Main function for optimized project. */
 int
-main (void)
+main (int argc, char *argv[])
 {
-  char file_name[NAME_LENGTH_MAX];
-  int file_idx = 0;
-
-  /* Set OpenMP parallel degree. */
-  NUM_THREADS = omp_get_num_procs () > (FILE_NUM / 2) ? (FILE_NUM / 2) : omp_get_num_procs ();
+  int opt;
 
-  /* Unzip to get source files. */
-  runProcess ("Unzipping source file", decompress);
+  /* Parallel degrees from the environment, unless given as an option. */
+  if (getenv ("TS_THREADS") != NULL && tsParseThreads (getenv ("TS_THREADS"), &DEGREES) != 0)
+    {
+      fprintf (stderr, "Ignoring TS_THREADS, expected <n> or <phase>=<n>,...\n");
+      memset (&DEGREES, 0, sizeof (DEGREES));
+    }
 
-  /* Globally open source files. */
-  for (int date = 7; date <= 12; date++)
-    for (int id = 0; id < (date == 12 ? 2 : 6); id++)
+  /* Parse options. */
+  while ((opt = getopt (argc, argv, "a:bc:F:i:j:k:K:l:m:n:r:s:S:t:v:y:z:")) != -1)
+    switch (opt)
       {
-        sprintf (file_name, "input/20160222%02d-LUN%d.csv", date, LUN_idx_arr[id]);
-        global_src_file[file_idx] = fopen (file_name, "r");
-        file_idx++;
+      case 'a':
+        if ((AGG_MASK = parseAggMask (optarg)) < 0)
+          {
+            fprintf (stderr, "Unknown aggregate in `%s'.\n", optarg);
+            return 1;
+          }
+        break;
+      case 'b':
+        BATCH = 1;
+        break;
+      case 'c':
+        if (optarg[0] != 'R' && optarg[0] != 'W')
+          {
+            fprintf (stderr, "Streamed IO type must be R or W.\n");
+            return 1;
+          }
+        STREAM_MODE = optarg[0] == 'W' ? TS_WRITE : TS_READ;
+        STREAM_SOCKET = optarg[1] == '@' ? optarg + 2 : NULL;
+        break;
+      case 'F':
+        if (tsParseSchema (optarg, &SCHEMA) != 0)
+          {
+            fprintf (stderr, "Layout must be systor, msr, alibaba or <field>=<column>,...\n");
+            return 1;
+          }
+        break;
+      case 'i':
+        INPUT_DIR = optarg;
+        break;
+      case 'j':
+        memset (&DEGREES, 0, sizeof (DEGREES));
+        if (tsParseThreads (optarg, &DEGREES) != 0)
+          {
+            fprintf (stderr, "Parallel degrees must be <n> and/or <phase>=<n>,..., phases"
+                             " unzip, scan, read, sort, write.\n");
+            return 1;
+          }
+        break;
+      case 'k':
+      case 'K':
+        TOP_K = strtol (optarg, NULL, 10);
+        if (TOP_K <= 0)
+          {
+            fprintf (stderr, "Top-K count must be positive.\n");
+            return 1;
+          }
+        if (opt == 'K')
+          TOP_K = -TOP_K;
+        break;
+      case 'l':
+        for (char *lun = strtok (optarg, ","), *end; lun != NULL; lun = strtok (NULL, ","))
+          {
+            long int idx = strtol (lun, &end, 10);
+
+            if (end == lun || *end != '\0' || idx < 0 || idx >= 64)
+              {
+                fprintf (stderr, "LUNs must be numbers within 0..63, not `%s'.\n", lun);
+                return 1;
+              }
+            LUN_MASK |= 1UL << idx;
+          }
+        if (LUN_MASK == 0)
+          {
+            fprintf (stderr, "LUNs must be numbers within 0..63.\n");
+            return 1;
+          }
+        break;
+      case 'm':
+        MANIFEST = optarg;
+        break;
+      case 'n':
+        if (atoi (optarg) < 1)
+          {
+            fprintf (stderr, "Shard count must be positive.\n");
+            return 1;
+          }
+        SHARDS = atoi (optarg);
+        break;
+      case 'r':
+        REUSE_RATE = atof (optarg);
+        if (REUSE_RATE <= 0 || REUSE_RATE > 1)
+          {
+            fprintf (stderr, "Reuse sampling rate must be in (0, 1].\n");
+            return 1;
+          }
+        break;
+      case 's':
+        if (sscanf (optarg, "%u:%u", &SIZE_LO, &SIZE_HI) < 1
+            || (SIZE_HI != 0 && SIZE_HI < SIZE_LO))
+          {
+            fprintf (stderr, "Size range must be <min>[:<max>].\n");
+            return 1;
+          }
+        break;
+      case 'S':
+        if (tsParseSortKey (optarg, SORT_KEY) != 0)
+          {
+            fprintf (stderr, "Sort key must be up to two of [-]size, [-]time.\n");
+            return 1;
+          }
+        break;
+      case 't':
+        if (sscanf (optarg, "%lf:%lf", &TS_FROM, &TS_TO) < 1 || (TS_TO != 0 && TS_TO <= TS_FROM))
+          {
+            fprintf (stderr, "Time window must be <from>[:<to>].\n");
+            return 1;
+          }
+        break;
+      case 'v':
+        for (char *view = strtok (optarg, ","); view != NULL; view = strtok (NULL, ","))
+          if (strcmp (view, "lun") == 0)
+            VIEWS |= TS_VIEW_LUN;
+          else if (strcmp (view, "time") == 0)
+            VIEWS |= TS_VIEW_TIME;
+          else
+            {
+              fprintf (stderr, "Unknown view `%s', expected lun or time.\n", view);
+              return 1;
+            }
+        break;
+      case 'y':
+        IO_TYPES = strchr (optarg, 'R') ? 1 << TS_READ : 0;
+        IO_TYPES |= strchr (optarg, 'W') ? 1 << TS_WRITE : 0;
+        if (IO_TYPES == 0)
+          {
+            fprintf (stderr, "IO types must be R, W or RW.\n");
+            return 1;
+          }
+        break;
+      case 'z':
+        GZIP_LEVEL = atoi (optarg);
+        if (GZIP_LEVEL < 1 || GZIP_LEVEL > 9)
+          {
+            fprintf (stderr, "Compression level must be 1..9.\n");
+            return 1;
+          }
+        break;
+      default:
+        fprintf (stderr, "Usage: %s [-a lun,hour,bytes,latency|all] [-i input_dir | -m manifest]"
+                         " [-s min[:max]] [-t from[:to]] [-l lun,...] [-y R|W] [-k K | -K K]"
+                         " [-n shards] [-v lun,time] [-r rate] [-z level]"
+                         " [-F layout] [-S key] [-j degrees] [-c R|W[@socket] | -b archive ...]\n",
+                 argv[0]);
+        return 1;
       }
+  opts = (ts_options) {.agg_mask = AGG_MASK, .gzip_level = GZIP_LEVEL, .size_min = SIZE_LO,
+                       .size_max = SIZE_HI, .top_k = TOP_K, .shards = SHARDS, .ts_from = TS_FROM,
+                       .ts_to = TS_TO, .lun_mask = LUN_MASK, .io_types = IO_TYPES,
+                       .views = VIEWS, .reuse_rate = REUSE_RATE,
+                       .schema = SCHEMA, .threads = DEGREES.threads};
+  memcpy (opts.sort_key, SORT_KEY, sizeof (SORT_KEY));
+  memcpy (opts.phase_threads, DEGREES.phase_threads, sizeof (DEGREES.phase_threads));
+  if (SHARDS > 0 && SORT_KEY[0] != 0 && SORT_KEY[0] != TS_KEY_SIZE)
+    {
+      fprintf (stderr, "Shards need a sort key led by ascending size.\n");
+      return 1;
+    }
 
-  /* Collect necessary statistics. */
-  runProcess ("Collecting statistics", scanStatistics);
+  /* Stage timings leave stdout to the stream. */
+  LOG_FILE = STREAM_MODE >= 0 ? stderr : stdout;
 
-  /* Allocate memory space for huge node arrays. */
-  node_arr[R_IDX] = malloc (sizeof (node) * (NUM[R_IDX] + 1));
-  node_arr[W_IDX] = malloc (sizeof (node) * (NUM[W_IDX] + 1));
-  size_cnt_arr[R_IDX] = malloc (sizeof (cnt_struct) * CNT[R_IDX]);
-  size_cnt_arr[W_IDX] = malloc (sizeof (cnt_struct) * CNT[W_IDX]);
+  /* Archives of a batch share one context and overlap their stages. */
+  if (BATCH)
+    {
+      if (optind == argc || MANIFEST != NULL || STREAM_MODE >= 0)
+        {
+          fprintf (stderr, "Batch mode takes archives or directories, without -m or -c.\n");
+          return 1;
+        }
+      return runBatch (argc - optind, argv + optind);
+    }
 
-  /* Initialize size count array. */
-  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
-    for (int i = 0; i < CNT[mode_idx]; i++)
-      {
-        size_cnt_arr[mode_idx][i].size = 0;
-        size_cnt_arr[mode_idx][i].cnt = 0;
-      }
+  /* Unzip to get source files, unless they are listed explicitly. */
+  if (MANIFEST == NULL)
+    runProcess ("Unzipping source file", decompress);
+
+  /* Find source files; the context sets OpenMP parallel degree from their number. */
+  ctx = tsCreate (&opts);
+  if (discoverInputs (INPUT_DIR) == 0)
+    {
+      fprintf (stderr, "No source files found.\n");
+      tsDestroy (ctx);
+      return 1;
+    }
 
-  /* Read -> Sort -> Write processes. */
+  /* Scan -> Read -> Sort -> Write processes. */
+  runProcess ("Collecting statistics", scanStatistics);
   runProcess ("Abstractively reading", abstractRead);
   runProcess ("Sorting lines by heap", sortEntries);
   runProcess ("Writing and attaching", writeResult);
+  reportPhases (MANIFEST == NULL ? &unzip_tune : NULL);
+  reportLongLines ();
 
   /* Release memory spaces. */
-  free (node_arr[R_IDX]);
-  free (node_arr[W_IDX]);
-  free (size_cnt_arr[R_IDX]);
-  free (size_cnt_arr[W_IDX]);
-
-  /* Close globally opened files. */
-  for (int i = 0; i < FILE_NUM; i++)
-    fclose (global_src_file[i]);
+  tsDestroy (ctx);
 
-  return 0;
+  return write_failed;
 }
 
 /* Decompression process handler. */
 void
 decompress (void)
 {
-  char tar_file[NAME_LENGTH_MAX] = "input/systor17-01.tar";   // `tar' file.
-  int file_cnt = FILE_NUM;                                    // `.csv.gz' files.
+  char tar_file[NAME_LENGTH_MAX];
 
-  /* Untar the source file. */
-  if (fork () == 0)
-    execl ("/bin/tar", "tar", "-xf", tar_file, "-C", "input", NULL);
-  else
-    wait (NULL);
-
-  /* Use OpenMP for paralleled unzipping. */
-  #pragma omp parallel for num_threads(NUM_THREADS)
-  for (int id = 0; id < 6; id++)
-    {
-      char gz_file[NAME_LENGTH_MAX];
-
-      /* Use separate processes for unzipping different files. */
-      for (int date = 7; date <= (id < 2 ? 12 : 11); date++)
-        {
-          sprintf (gz_file, "input/20160222%02d-LUN%d.csv.gz", date, LUN_idx_arr[id]);
-          if (fork () == 0)
-            execl ("/bin/gunzip", "gunzip", "-qf", gz_file, NULL);
-        }
-    }
-
-  /* Wait for all unzipping processes to finish. */
-  while (file_cnt-- > 0)
-    wait (NULL);
+  snprintf (tar_file, NAME_LENGTH_MAX, "%s/systor17-01.tar", INPUT_DIR);
+  unpackInputs (access (tar_file, R_OK) == 0 ? tar_file : NULL, INPUT_DIR);
 }
 
 /* Statistics collecting process handler. */
 void
 scanStatistics (void)
 {
-  int size_mark[2][SIZE_MAX] = {0};
-  long unsigned int R_num_tmp = 0, W_num_tmp = 0;
-
-  /* Use OpenMP for paralleled statistics scanning. */
-  #pragma omp parallel for num_threads(NUM_THREADS) reduction(+:R_num_tmp, W_num_tmp)
-  for (int i = 0; i < FILE_NUM; i++)        // Each thread has several independent
-    {                                       // source files to work with.
-      FILE *src_file = global_src_file[i];
-      char line[LINE_LENGTH_MAX], mode;
-      unsigned int size, mode_idx;
-      double time_stamp;
-
-      /* Scan each trace entry. */
-      fscanf (src_file, "%*s\n");     // Abandon the instruction line. 
-      while (fscanf (src_file, "%s\n", line) == 1)
-        {
-          /* Extract informations. */
-          if (line[21] == ',')
-            sscanf (line, "%lf,,%c,%*d,%*d,%u", &time_stamp, &mode, &size);
-          else
-            sscanf (line, "%lf,%*f,%c,%*d,%*d,%u", &time_stamp, &mode, &size);
-          mode_idx = mode == 'W' ? W_IDX : R_IDX;
-
-          /* Update statistics. */
-          if (mode_idx == R_IDX)
-            R_num_tmp++;
-          else
-            W_num_tmp++;
-          size_mark[mode_idx][size] = 1;
-          NUM_ARR[mode_idx][i]++;
-        }
-      fseek (src_file, 0, SEEK_SET);  // Reset source file position.
-    }
-  NUM[R_IDX] = R_num_tmp;
-  NUM[W_IDX] = W_num_tmp;
-
-  /* Acquire number of different sizes. */
-  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
-    for (long unsigned int i = 0; i < SIZE_MAX; i++)
-      if (size_mark[mode_idx][i] == 1)
-        CNT[mode_idx]++;
+  tsScanStatistics (ctx);
 }
 
 /* Abstraction read process handler. */
 void
 abstractRead (void)
 {
-  long unsigned int slot_idx_arr[2][FILE_NUM] = {0};
+  tsAbstractRead (ctx);
+}
+
+/* Entries sorting process handler. */
+void
+sortEntries (void)
+{
+  tsSortEntries (ctx);
+}
 
-  /* Accumulate the slot indexes that each file starts. */
-  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
-    for (int i = 1; i < FILE_NUM; i++)
-      slot_idx_arr[mode_idx][i] = slot_idx_arr[mode_idx][i - 1] + NUM_ARR[mode_idx][i - 1];
+/* Result writing process handler. */
+void
+writeResult (void)
+{
+  int fd = STDOUT_FILENO;
 
-  /* Use OpenMP for paralleled reading. */
-  #pragma omp parallel num_threads(NUM_THREADS)
+  if (STREAM_MODE < 0)
     {
-      int thread_id = omp_get_thread_num (), num_threads = omp_get_num_threads ();
-      int workload = FILE_NUM / num_threads;
-      int start = 0 + thread_id * workload;
-      int end = thread_id == num_threads - 1 ? FILE_NUM : start + workload;
-      long unsigned int slot_idx[2] = {slot_idx_arr[R_IDX][start], slot_idx_arr[W_IDX][start]};
-
-      /* Read and create nodes. */
-      for (int i = start; i < end; i++)   // Each thread has several independent
-        {                                 // source files to work with.
-          FILE *src_file = global_src_file[i];
-          long unsigned int offset = INST_LINE_LENGTH;
-          char line[LINE_LENGTH_MAX], mode;
-          unsigned int size, mode_idx;
-          double time_stamp;
-
-          /* Scan each trace entry. */
-          fscanf (src_file, "%*s\n");     // Abandon the instruction line.
-          while (fscanf (src_file, "%s\n", line) == 1)
-            {
-              /* Extract informations. */
-              if (line[21] == ',')
-                sscanf (line, "%lf,,%c,%*d,%*d,%u", &time_stamp, &mode, &size);
-              else
-                sscanf (line, "%lf,%*f,%c,%*d,%*d,%u", &time_stamp, &mode, &size);
-              mode_idx = mode == 'W' ? W_IDX : R_IDX;
-
-              /* Fill in an empty slot in corresponding node array. */
-              slot_idx[mode_idx]++;
-              node_arr[mode_idx][slot_idx[mode_idx]].size = size;
-              node_arr[mode_idx][slot_idx[mode_idx]].time_stamp = time_stamp;
-              node_arr[mode_idx][slot_idx[mode_idx]].src_file_idx = i;
-              node_arr[mode_idx][slot_idx[mode_idx]].offset = offset;
-              node_arr[mode_idx][slot_idx[mode_idx]].write_offset = strlen (line) + 1;
-
-              /* Update offset. */
-              offset += strlen (line) + 1;
-            }
+      if (tsWriteResult (ctx) != 0)
+        {
+          fprintf (stderr, " Cannot write results into %s !\n", out_dir);
+          write_failed = 1;
+        }
+      return;
+    }
+
+  /* Stream one IO type in order to stdout, or to a Unix socket. */
+  if (STREAM_SOCKET != NULL)
+    {
+      struct sockaddr_un addr = {.sun_family = AF_UNIX};
+
+      strncpy (addr.sun_path, STREAM_SOCKET, sizeof (addr.sun_path) - 1);
+      fd = socket (AF_UNIX, SOCK_STREAM, 0);
+      if (connect (fd, (struct sockaddr *) &addr, sizeof (addr)) != 0)
+        {
+          fprintf (stderr, " Cannot connect to %s !\n", STREAM_SOCKET);
+          close (fd);
+          write_failed = 1;
+          return;
         }
     }
+  signal (SIGPIPE, SIG_IGN);        // A consumer leaving early fails the stream instead.
+  if (tsStreamResult (ctx, STREAM_MODE, fd) != 0)
+    {
+      fprintf (stderr, " Stream ended early.\n");
+      write_failed = 1;
+    }
+  if (STREAM_SOCKET != NULL)
+    close (fd);
 }
 
-/* Entries sorting process handler. */
-void
-sortEntries (void)
+/* Auxiliary function for untarring TAR_FILE (if any) into DIR and unzipping every
+   compressed source file there. */
+static void
+unpackInputs (const char *tar_file, const char *dir)
 {
-  /* For two node arrays, use heap-sort in ascending order. */
-  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+  char pattern[NAME_LENGTH_MAX];
+  glob_t gz_glob;                                             // `.csv.gz' files.
+  long unsigned int gz_num = 0, procs = omp_get_num_procs ();
+
+  /* Untar the source file, if present. */
+  if (tar_file != NULL)
     {
-      long unsigned int heap_size = NUM[mode_idx];
+      pid_t pid;
 
-      /* Setup dummy head. */
-      node_arr[mode_idx][0].size = 0;
-      node_arr[mode_idx][0].time_stamp = 0;
-      node_arr[mode_idx][0].src_file_idx = 0;
-      node_arr[mode_idx][0].offset = 0;
-      node_arr[mode_idx][0].write_offset = INST_LINE_LENGTH;
+      if ((pid = fork ()) == 0)
+        execl ("/bin/tar", "tar", "-xf", tar_file, "-C", dir, NULL);
+      else
+        waitpid (pid, NULL, 0);
+    }
 
-      /* Build heap by Floyd. */
-      for (long unsigned int i = NUM[mode_idx] / 2 + 1; i > 0; i--)
-        heapify (node_arr[mode_idx], heap_size, i);
+  /* Discover every compressed source file. */
+  snprintf (pattern, NAME_LENGTH_MAX, "%s/*.csv.gz", dir);
+  if (glob (pattern, 0, NULL, &gz_glob) != 0)
+    {
+      unzip_tune.name = NULL;         // Nothing unzipped, nothing to report.
+      return;
+    }
 
-      /* Iteratively extract heap top and place at tail. */
-      for (long unsigned int i = NUM[mode_idx]; i > 1; i--)
+  /* Files pruned by name are left compressed. */
+  for (long unsigned int i = 0; i < gz_glob.gl_pathc; i++)
+    if (tsMayMatch (&opts, gz_glob.gl_pathv[i]))
+      {
+        char *path = gz_glob.gl_pathv[i];
+
+        gz_glob.gl_pathv[i] = gz_glob.gl_pathv[gz_num];
+        gz_glob.gl_pathv[gz_num++] = path;
+      }
+
+  /* Use OpenMP for paralleled unzipping, each thread keeps one child process busy;
+     files go in rounds, the first ones probing parallel degrees. */
+  initTune (&unzip_tune, "unzip", procs, 2 * procs < gz_num ? 2 * procs : gz_num,
+            opts.phase_threads[TS_PHASE_UNZIP] ? opts.phase_threads[TS_PHASE_UNZIP]
+                                               : opts.threads);
+  for (long unsigned int next = 0, round; next < gz_num; next += round)
+    {
+      long unsigned int bytes = 0;
+
+      round = tuneBegin (&unzip_tune, gz_num - next, gz_num);
+      #pragma omp parallel for num_threads(unzip_tune.degree) schedule(dynamic) \
+                               reduction(+:bytes)
+      for (long unsigned int i = next; i < next + round; i++)
         {
-          swap (&node_arr[mode_idx][1], &node_arr[mode_idx][i]);
-          heap_size--;
-          heapify (node_arr[mode_idx], heap_size, 1);
+          struct stat st;
+          pid_t pid;
+
+          if (stat (gz_glob.gl_pathv[i], &st) == 0)
+            bytes += st.st_size;
+          if ((pid = fork ()) == 0)
+            execl ("/bin/gunzip", "gunzip", "-qf", gz_glob.gl_pathv[i], NULL);
+          else
+            waitpid (pid, NULL, 0);
         }
+      tuneEnd (&unzip_tune, bytes);
     }
+  globfree (&gz_glob);
+}
+
+/* Auxiliary function for finding source files, from the manifest or DIR. */
+static unsigned int
+discoverInputs (const char *dir)
+{
+  unsigned int file_num = 0;
 
-  /* Calculate size counts data in sorted order. */
-  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+  if (MANIFEST != NULL)
     {
-      for (long unsigned int i = 1; i <= NUM[mode_idx]; i++)
-        for (unsigned int j = 0; j < CNT[mode_idx]; j++)
-          {
-            if (size_cnt_arr[mode_idx][j].size == node_arr[mode_idx][i].size)   // Already met.
-              {
-                size_cnt_arr[mode_idx][j].cnt++;
-                break;
-              }
-            else if (size_cnt_arr[mode_idx][j].size == 0)                       // First found.
-              {
-                size_cnt_arr[mode_idx][j].size = node_arr[mode_idx][i].size;
-                size_cnt_arr[mode_idx][j].cnt = 1;
-                break;
-              }
-          }
+      FILE *list_file = fopen (MANIFEST, "r");
+      char name[NAME_LENGTH_MAX];
+
+      if (list_file == NULL)
+        return 0;
+      while (fscanf (list_file, "%255s", name) == 1)
+        if (tsMayMatch (&opts, name) && tsAddFile (ctx, name) >= 0)
+          file_num++;
+      fclose (list_file);
     }
+  else
+    {
+      char pattern[NAME_LENGTH_MAX];
+      glob_t csv_glob;
+
+      snprintf (pattern, NAME_LENGTH_MAX, "%s/*.csv", dir);
+      if (glob (pattern, 0, NULL, &csv_glob) != 0)
+        return 0;
+      for (long unsigned int i = 0; i < csv_glob.gl_pathc; i++)
+        if (tsMayMatch (&opts, csv_glob.gl_pathv[i])
+            && tsAddFile (ctx, csv_glob.gl_pathv[i]) >= 0)
+          file_num++;
+      globfree (&csv_glob);
+    }
+
+  return file_num;
 }
 
-/* Result writing process handler. */
-void
-writeResult (void)
+/* Auxiliary function for sorting every archive of a batch through one context, so
+   threads and node arrays carry over: an unpacking thread works ahead while the
+   stages of the previous archive run. Results go to output/<archive name>/. */
+static int
+runBatch (int num, char **archives)
 {
-  /* Calculate the offset in destination files to write at. */
-  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
-    for (long unsigned int i = 1; i <= NUM[mode_idx]; i++)
-      node_arr[mode_idx][i].write_offset += node_arr[mode_idx][i - 1].write_offset;
+  pthread_t unpacker;
+  unsigned int failed = 0;
 
-  /* Use OpenMP for paralleled writing. */
-  #pragma omp parallel num_threads(NUM_THREADS)
+  job_arr = calloc (num, sizeof (batch_job));
+  job_num = num;
+  for (unsigned int i = 0; i < job_num; i++)
     {
-      FILE *dst_file[2], *local_src_file[FILE_NUM];
-      char file_name[NAME_LENGTH_MAX], line[LINE_LENGTH_MAX];
-      int file_idx = 0;
-
-      /* Open source files and destination files locally. */
-      for (int date = 7; date <= 12; date++)
-        for (int id = 0; id < (date == 12 ? 2 : 6); id++)
-          {
-            sprintf (file_name, "input/20160222%02d-LUN%d.csv", date, LUN_idx_arr[id]);
-            local_src_file[file_idx] = fopen (file_name, "r");
-            file_idx++;
-          }
-      dst_file[R_IDX] = fopen ("output/R.csv", "w");
-      dst_file[W_IDX] = fopen ("output/W.csv", "w");
+      batch_job *job = &job_arr[i];
+      char stem[NAME_LENGTH_MAX], *base;
+      struct stat st;
+
+      /* Name jobs after the archive, less its `.tar' or trailing slash. */
+      snprintf (stem, NAME_LENGTH_MAX, "%s", archives[i]);
+      while (strlen (stem) > 1 && stem[strlen (stem) - 1] == '/')
+        stem[strlen (stem) - 1] = '\0';
+      if (strlen (stem) > 4 && strcmp (stem + strlen (stem) - 4, ".tar") == 0)
+        stem[strlen (stem) - 4] = '\0';
+      base = strrchr (stem, '/') ? strrchr (stem, '/') + 1 : stem;
+
+      job->archive = archives[i];
+      job->is_dir = stat (archives[i], &st) == 0 && S_ISDIR (st.st_mode);
+      if (job->is_dir)
+        snprintf (job->in_dir, NAME_LENGTH_MAX, "%s", archives[i]);
+      else
+        snprintf (job->in_dir, NAME_LENGTH_MAX, "%s/%s", INPUT_DIR, base);
+      snprintf (job->out_dir, NAME_LENGTH_MAX, "output/%s", base);
+    }
+  pthread_create (&unpacker, NULL, unpackJobs, NULL);
 
-      /* Write the lines into destination files. */
-      for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+  ctx = tsCreate (&opts);
+  for (unsigned int i = 0; i < job_num; i++)
+    {
+      batch_job *job = &job_arr[i];
+      ts_options job_opts = opts;
+
+      pthread_mutex_lock (&job_lock);
+      while (!job->unpacked)
+        pthread_cond_wait (&job_cond, &job_lock);
+      pthread_mutex_unlock (&job_lock);
+
+      fprintf (LOG_FILE, " Batch %u/%u: %s\n", i + 1, job_num, job->archive);
+      logTime ("Unzipping source file", &job->unpack_start, &job->unpack_end);
+      mkdir (job->out_dir, 0755);
+      job_opts.out_dir = out_dir = job->out_dir;
+      tsReset (ctx, &job_opts);
+      if (discoverInputs (job->in_dir) == 0)
         {
-          int thread_id = omp_get_thread_num (), num_threads = omp_get_num_threads ();
-          long unsigned int workload = NUM[mode_idx] / num_threads;
-          long unsigned int start = 1 + thread_id * workload;
-          long unsigned int end = thread_id == num_threads - 1 ? NUM[mode_idx] + 1 : start + workload;
+          fprintf (stderr, " No source files found in %s.\n", job->in_dir);
+          failed++;
+        }
+      else
+        {
+          runProcess ("Collecting statistics", scanStatistics);
+          runProcess ("Abstractively reading", abstractRead);
+          runProcess ("Sorting lines by heap", sortEntries);
+          runProcess ("Writing and attaching", writeResult);
+          reportPhases (&job->unzip);
+          reportLongLines ();
+          failed += write_failed;
+          write_failed = 0;
+        }
 
-          /* First thread writes the instruction line, others start from section head. */
-          if (thread_id == 0)
-            {
-              fseek (dst_file[mode_idx], 0, SEEK_SET);
-              fprintf (dst_file[mode_idx], "Timestamp,Response,IOType,LUN,Offset,Size\n");
-            }
-          else
-            fseek (dst_file[mode_idx], node_arr[mode_idx][start - 1].write_offset, SEEK_SET);
-
-          /* All threads write entries concurrently. */
-          for (long unsigned int i = start; i < end; i++)   // Each thread has own independent
-            {                                               // lines section to work with.
-              fseek (local_src_file[node_arr[mode_idx][i].src_file_idx],
-                     node_arr[mode_idx][i].offset, SEEK_SET);
-              fscanf (local_src_file[node_arr[mode_idx][i].src_file_idx], "%s\n", line);
-              fprintf (dst_file[mode_idx], "%s\n", line);
-            }
+      pthread_mutex_lock (&job_lock);
+      job_done = i + 1;
+      pthread_cond_broadcast (&job_cond);
+      pthread_mutex_unlock (&job_lock);
+    }
 
-          /* Last thread writes the size counts data. */
-          if (thread_id == num_threads - 1)
-            {
-              fprintf (dst_file[mode_idx], "\nSIZE,COUNT\n");
-              for (unsigned int j = 0; j < CNT[mode_idx]; j++)
-                {
-                  if (size_cnt_arr[mode_idx][j].size == 0)
-                    break;
-                  fprintf (dst_file[mode_idx], "%u,%lu\n", size_cnt_arr[mode_idx][j].size,
-                                                           size_cnt_arr[mode_idx][j].cnt);
-                } 
-            }
-        }
+  pthread_join (unpacker, NULL);
+  tsDestroy (ctx);
+  free (job_arr);
+  return failed > 0;
+}
 
-      /* Close locally opened files. */
-      for (int i = 0; i < FILE_NUM; i++)
-        fclose (local_src_file[i]);
-      fclose (dst_file[R_IDX]);
-      fclose (dst_file[W_IDX]);
+/* Auxiliary function for unpacking the archives of a batch in order, at most
+   BATCH_AHEAD of them ahead of the one being sorted. */
+static void *
+unpackJobs (void *arg)
+{
+  for (unsigned int i = 0; i < job_num; i++)
+    {
+      batch_job *job = &job_arr[i];
+
+      pthread_mutex_lock (&job_lock);
+      while (i > job_done + BATCH_AHEAD)
+        pthread_cond_wait (&job_cond, &job_lock);
+      pthread_mutex_unlock (&job_lock);
+
+      gettimeofday (&job->unpack_start, NULL);
+      if (!job->is_dir)
+        mkdir (job->in_dir, 0755);
+      unpackInputs (job->is_dir ? NULL : job->archive, job->in_dir);
+      gettimeofday (&job->unpack_end, NULL);
+      job->unzip = unzip_tune;
+
+      pthread_mutex_lock (&job_lock);
+      job->unpacked = 1;
+      pthread_cond_broadcast (&job_cond);
+      pthread_mutex_unlock (&job_lock);
     }
+
+  return arg;
 }
 
 /* Auxiliary function for running a process section. */
@@ -385,48 +594,60 @@ runProcess (char *name, PROCESS func)
   struct timeval tv_start, tv_end;
   int sec, usec;
 
-  printf (" %21s...", name);
-  fflush (stdout);
+  fprintf (LOG_FILE, " %21s...", name);
+  fflush (LOG_FILE);
   gettimeofday (&tv_start, NULL);
   func ();
   gettimeofday (&tv_end, NULL);
 
   sec = tv_end.tv_sec - tv_start.tv_sec;
   usec = tv_end.tv_usec - tv_start.tv_usec;
-  printf ("finished. Takes %2d.%07d secs.\n", sec, usec > 0 ? usec : 1000000 - usec);
+  if (usec < 0)                     // Borrow a second.
+    {
+      sec--;
+      usec += 1000000;
+    }
+  fprintf (LOG_FILE, "finished. Takes %2d.%06d secs.\n", sec, usec);
 }
 
-/* Auxiliary function for heapify. */
+/* Auxiliary function for reporting a section timed elsewhere, like runProcess does. */
 static void
-heapify (node *arr, long unsigned int len, long unsigned int pivot)
+logTime (char *name, const struct timeval *tv_start, const struct timeval *tv_end)
 {
-  while (1)
-    {
-      long unsigned int left = 2 * pivot;
-      long unsigned int right = 2 * pivot + 1;
-      long unsigned int largest = (left <= len && larger (&arr[left], &arr[pivot])) ? left : pivot;
+  int sec = tv_end->tv_sec - tv_start->tv_sec;
+  int usec = tv_end->tv_usec - tv_start->tv_usec;
 
-      if (right <= len && larger (&arr[right], &arr[largest]))
-        largest = right;
-      if (largest == pivot)
-        break;
-      swap (&arr[pivot], &arr[largest]);
-      pivot = largest;
+  if (usec < 0)
+    {
+      sec--;
+      usec += 1000000;
     }
+  fprintf (LOG_FILE, " %21s...finished. Takes %2d.%06d secs.\n", name, sec, usec);
 }
 
-/* Auxiliary function for swapping. */
-static inline void
-swap (node *a, node *b)
+/* Auxiliary function for reporting the parallel degree every phase ran at, UNZIP
+   being NULL when nothing was unzipped. */
+static void
+reportPhases (const tune_phase *unzip)
 {
-  node tmp = *a;
-  *a = *b;
-  *b = tmp;
+  fprintf (LOG_FILE, " Concurrency: ");
+  if (unzip != NULL && unzip->name != NULL)
+    {
+      tuneReport (unzip, LOG_FILE);
+      fprintf (LOG_FILE, ", ");
+    }
+  for (int phase = TS_PHASE_SCAN; phase < TS_PHASES; phase++)
+    {
+      tsReportPhase (ctx, phase, LOG_FILE);
+      fprintf (LOG_FILE, phase < TS_PHASES - 1 ? ", " : "\n");
+    }
 }
 
-/* Auxiliary function for comparing nodes. */
-static inline int
-larger (node *a, node *b)
+/* Auxiliary function for warning about source lines too long to be sorted. */
+static void
+reportLongLines (void)
 {
-  return (a->size > b->size) || (a->size == b->size && a->time_stamp > b->time_stamp);
+  if (tsLongLines (ctx) > 0)
+    fprintf (stderr, " Skipped %lu lines longer than %d bytes.\n", tsLongLines (ctx),
+             TS_LINE_MAX);
 }
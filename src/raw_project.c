@@ -326,7 +326,12 @@ runProcess (char *name, PROCESS func)
 
   sec = tv_end.tv_sec - tv_start.tv_sec;
   usec = tv_end.tv_usec - tv_start.tv_usec;
-  printf ("finished. Takes %2d.%07d secs.\n", sec, usec > 0 ? usec : 1000000 - usec);
+  if (usec < 0)                     // Borrow a second.
+    {
+      sec--;
+      usec += 1000000;
+    }
+  printf ("finished. Takes %2d.%06d secs.\n", sec, usec);
 }
 
 /* Auxiliary function for heapify. */
@@ -0,0 +1,369 @@
+/*
+ * Trace replay against local files or block devices, with latency report.
+ *
+ */
+
+#define _GNU_SOURCE           // For `O_DIRECT'.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <omp.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#include "aggregate.h"
+#include "tracesort.h"
+
+#pragma GCC diagnostic ignored "-Wunused-result"  // Shutdown unused warnings for `fscanf'.
+
+/* Predefined constants. */
+#define LUN_MAX 64            // LUNs that can be mapped.
+#define LUN_OTHER LUN_MAX     // Target slot of every larger LUN, served by `-f' only.
+#define R_IDX 0               // Index of reads.
+#define W_IDX 1               // Index of writes.
+#define ALIGN 4096            // Offset and buffer alignment for direct IO.
+
+/* Type definitions. */
+typedef struct                    // Type of a replayed entry (24 bytes).
+  {
+    double time_stamp;
+    long unsigned int offset;
+    unsigned int size;
+    unsigned short lun;
+    unsigned short mode_idx;
+  } io_entry;
+typedef struct                    // Type of a LUN target.
+  {
+    const char *path;
+    int fd;
+    long unsigned int span;         // Bytes addressable, offsets wrap into it.
+  } target;
+
+/* Subroutine definitions. */
+static int loadTrace (const char *name);
+static int openTargets (void);
+static int cmpTime (const void *a, const void *b);
+static inline double now (void);
+
+/* Run options. */
+static int QUEUE_DEPTH = 1;                           // Outstanding IOs (`-q').
+static double SPEED = 0;                              // Time stamp scaling, 0 for none (`-s').
+static int TIME_ORDER = 0;                            // Replay in time stamp order (`-o').
+static int ALLOW_WRITE = 0;                           // Issue writes too (`-W').
+static int DIRECT = 0;                                // Bypass the page cache (`-d').
+static const char *DEFAULT_PATH = NULL;               // Target of unmapped LUNs (`-f').
+static ts_schema SCHEMA;                              // Layout of trace lines (`-F').
+
+/* Global variables or containers. */
+static io_entry *entry_arr;
+static long unsigned int entry_num = 0, entry_cap = 0;
+static target target_arr[LUN_MAX + 1];
+
+/* Replay trace files and report IOPS, bandwidth and latency per size. */
+int
+main (int argc, char *argv[])
+{
+  unsigned int *sizes[2], *size_slot[2], size_num[2] = {0}, max_size = 0;
+  long unsigned int next = 0, skipped = 0, failed = 0, done[2] = {0}, bytes[2] = {0};
+  aggregate agg_arr[2];
+  double start, elapsed, ts_base = 1e300;
+  int opt;
+
+  /* Parse options. */
+  while ((opt = getopt (argc, argv, "df:F:m:oq:s:W")) != -1)
+    switch (opt)
+      {
+      case 'd':
+        DIRECT = 1;
+        break;
+      case 'f':
+        DEFAULT_PATH = optarg;
+        break;
+      case 'F':
+        if (tsParseSchema (optarg, &SCHEMA) != 0)
+          optind = argc;
+        break;
+      case 'm':
+        {
+          char *eq = strchr (optarg, '=');
+          unsigned int lun = strtoul (optarg, NULL, 10);
+
+          if (eq == NULL || lun >= LUN_MAX)
+            {
+              fprintf (stderr, "LUN mapping must be <lun>=<path>, LUN below %d.\n", LUN_MAX);
+              return 1;
+            }
+          target_arr[lun].path = eq + 1;
+          break;
+        }
+      case 'o':
+        TIME_ORDER = 1;
+        break;
+      case 'q':
+        QUEUE_DEPTH = atoi (optarg);
+        break;
+      case 's':
+        SPEED = strtod (optarg, NULL);
+        break;
+      case 'W':
+        ALLOW_WRITE = 1;
+        break;
+      default:
+        optind = argc;
+        break;
+      }
+  if (optind >= argc || QUEUE_DEPTH < 1 || SPEED < 0)
+    {
+      fprintf (stderr, "Usage: %s [-m lun=path ...] [-f path] [-F layout] [-q depth] [-s speed]"
+                       " [-o] [-W] [-d] <trace.csv> ...\n", argv[0]);
+      return 1;
+    }
+
+  /* Load entries and open targets. */
+  for (int i = optind; i < argc; i++)
+    if (loadTrace (argv[i]) != 0)
+      {
+        fprintf (stderr, " Cannot read %s !\n", argv[i]);
+        return 1;
+      }
+  if (entry_num == 0 || openTargets () != 0)
+    return 1;
+  if (TIME_ORDER)
+    qsort (entry_arr, entry_num, sizeof (io_entry), cmpTime);
+
+  /* Number the sizes in ascending order for the per-size report. */
+  for (long unsigned int i = 0; i < entry_num; i++)
+    {
+      if (entry_arr[i].size > max_size)
+        max_size = entry_arr[i].size;
+      if (entry_arr[i].time_stamp < ts_base)
+        ts_base = entry_arr[i].time_stamp;
+    }
+  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+    {
+      size_slot[mode_idx] = calloc (max_size + 1, sizeof (unsigned int));
+      sizes[mode_idx] = malloc (sizeof (unsigned int) * (max_size + 1));
+    }
+  for (long unsigned int i = 0; i < entry_num; i++)
+    size_slot[entry_arr[i].mode_idx][entry_arr[i].size] = 1;
+  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+    {
+      for (unsigned int size = 0; size <= max_size; size++)
+        if (size_slot[mode_idx][size])
+          {
+            size_slot[mode_idx][size] = size_num[mode_idx];
+            sizes[mode_idx][size_num[mode_idx]++] = size;
+          }
+      initAggregate (&agg_arr[mode_idx], AGG_BYTES | AGG_LATENCY, 0, 0, 0, size_num[mode_idx],
+                     sizes[mode_idx]);
+    }
+
+  /* Use OpenMP threads as the queue: each keeps one IO in flight, taking entries
+     in order from a shared cursor. */
+  start = now ();
+  #pragma omp parallel num_threads(QUEUE_DEPTH) reduction(+:skipped, failed)
+    {
+      aggregate local_agg[2];
+      char *buf = NULL;
+
+      posix_memalign ((void **) &buf, ALIGN, max_size + ALIGN);
+      memset (buf, 0x5a, max_size + ALIGN);
+      for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+        initAggregate (&local_agg[mode_idx], AGG_BYTES | AGG_LATENCY, 0, 0, 0,
+                       size_num[mode_idx], sizes[mode_idx]);
+
+      while (1)
+        {
+          long unsigned int i = __atomic_fetch_add (&next, 1, __ATOMIC_RELAXED);
+          io_entry *io;
+          target *tg;
+          long unsigned int offset, len;
+          double issue;
+          ssize_t ret;
+
+          if (i >= entry_num)
+            break;
+          io = &entry_arr[i];
+          tg = &target_arr[io->lun];
+          len = DIRECT ? (io->size + ALIGN - 1) / ALIGN * ALIGN : io->size;
+          if (tg->fd < 0 || (io->mode_idx == W_IDX && !ALLOW_WRITE) || len > tg->span)
+            {
+              skipped++;
+              continue;
+            }
+
+          /* Honor the (scaled) trace timing when asked. */
+          if (SPEED > 0)
+            {
+              double wait = (io->time_stamp - ts_base) / SPEED - (now () - start);
+
+              if (wait > 0)
+                usleep (wait * 1e6);
+            }
+
+          /* Offsets wrap into the target, aligned for direct IO. */
+          offset = io->offset % (tg->span - len + 1);
+          if (DIRECT)
+            offset -= offset % ALIGN;
+          issue = now ();
+          if (io->mode_idx == W_IDX)
+            ret = pwrite (tg->fd, buf, len, offset);
+          else
+            ret = pread (tg->fd, buf, len, offset);
+          if (ret < 0)
+            {
+              failed++;
+              continue;
+            }
+          accumulate (&local_agg[io->mode_idx], 0, 0, size_slot[io->mode_idx][io->size],
+                      (long int) ((now () - issue) * 1e9));
+        }
+
+      /* Merge thread-local accumulators. */
+      for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+        {
+          #pragma omp critical
+          mergeAggregate (&agg_arr[mode_idx], &local_agg[mode_idx]);
+          freeAggregate (&local_agg[mode_idx]);
+        }
+      free (buf);
+    }
+  elapsed = now () - start;
+
+  /* Report totals, then per size counts, bytes and latency percentiles. */
+  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+    for (unsigned int j = 0; j < size_num[mode_idx]; j++)
+      {
+        done[mode_idx] += agg_arr[mode_idx].size_cnt[j];
+        bytes[mode_idx] += agg_arr[mode_idx].size_cnt[j] * sizes[mode_idx][j];
+      }
+  printf ("TYPE,IOS,IOPS,MB/S\n");
+  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+    printf ("%c,%lu,%.1f,%.2f\n", mode_idx == R_IDX ? 'R' : 'W', done[mode_idx],
+            done[mode_idx] / elapsed, bytes[mode_idx] / elapsed / 1e6);
+  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+    if (done[mode_idx] > 0)
+      {
+        printf ("\n%c\n", mode_idx == R_IDX ? 'R' : 'W');
+        writeAggregate (&agg_arr[mode_idx], stdout);
+      }
+  fprintf (stderr, " %lu entries, %lu skipped, %lu failed, %.3f secs at depth %d.\n", entry_num,
+           skipped, failed, elapsed, QUEUE_DEPTH);
+
+  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+    {
+      freeAggregate (&agg_arr[mode_idx]);
+      free (sizes[mode_idx]);
+      free (size_slot[mode_idx]);
+    }
+  for (int lun = 0; lun <= LUN_OTHER; lun++)
+    if (target_arr[lun].fd >= 0)
+      close (target_arr[lun].fd);
+  free (entry_arr);
+  return 0;
+}
+
+/* Auxiliary function for loading the entries of a trace or result file, in file order,
+   through the sorter's own parser of the layout. */
+static int
+loadTrace (const char *name)
+{
+  FILE *src_file = fopen (name, "r");
+  char *line = NULL;
+  size_t line_cap = 0;
+
+  if (src_file == NULL)
+    return -1;
+  while (getline (&line, &line_cap, src_file) > 0)
+    {
+      io_entry *io;
+      ts_entry e;
+
+      if (line[0] == '\n')          // The SIZE,COUNT footer of result files follows.
+        break;
+      if (!tsParseLine (&SCHEMA, line, &e))   // The instruction line, or a header.
+        continue;
+      if (entry_num == entry_cap)
+        {
+          entry_cap = entry_cap ? entry_cap * 2 : 65536;
+          entry_arr = realloc (entry_arr, sizeof (io_entry) * entry_cap);
+        }
+      io = &entry_arr[entry_num++];
+      io->time_stamp = e.time_stamp;
+      io->offset = e.offset;
+      io->size = e.size;
+      io->mode_idx = e.mode == TS_WRITE ? W_IDX : R_IDX;
+      io->lun = e.lun < LUN_MAX ? e.lun : LUN_OTHER;
+    }
+  free (line);
+  fclose (src_file);
+
+  return 0;
+}
+
+/* Auxiliary function for opening the target of every LUN met. */
+static int
+openTargets (void)
+{
+  int flags = (ALLOW_WRITE ? O_RDWR : O_RDONLY) | (DIRECT ? O_DIRECT : 0);
+  char used[LUN_MAX + 1] = {0};
+
+  for (long unsigned int i = 0; i < entry_num; i++)
+    used[entry_arr[i].lun] = 1;
+  for (int lun = 0; lun <= LUN_OTHER; lun++)
+    {
+      target *tg = &target_arr[lun];
+      struct stat st;
+
+      tg->fd = -1;
+      if (tg->path == NULL)
+        tg->path = DEFAULT_PATH;
+      if (!used[lun])
+        continue;
+
+      /* Entries of LUNs without a target are skipped. */
+      if (tg->path == NULL)
+        {
+          if (lun == LUN_OTHER)
+            fprintf (stderr, " No target for LUNs from %d, skipping their entries.\n", LUN_MAX);
+          else
+            fprintf (stderr, " No target for LUN %d, skipping its entries.\n", lun);
+          continue;
+        }
+      if ((tg->fd = open (tg->path, flags)) < 0 || fstat (tg->fd, &st) != 0)
+        {
+          fprintf (stderr, " Cannot open %s for LUN %d%s !\n", tg->path, lun,
+                   lun == LUN_OTHER ? " and up" : "");
+          return -1;
+        }
+      if (S_ISBLK (st.st_mode))
+        ioctl (tg->fd, BLKGETSIZE64, &tg->span);
+      else
+        tg->span = st.st_size;
+    }
+
+  return 0;
+}
+
+/* Auxiliary function for ordering entries by time stamp. */
+static int
+cmpTime (const void *a, const void *b)
+{
+  double x = ((const io_entry *) a)->time_stamp, y = ((const io_entry *) b)->time_stamp;
+
+  return (x > y) - (x < y);
+}
+
+/* Auxiliary function for reading a monotonic clock, in seconds. */
+static inline double
+now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
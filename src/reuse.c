@@ -0,0 +1,175 @@
+/*
+ * Reuse distances through a Fenwick tree over last-access positions.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "reuse.h"
+
+static inline long unsigned int mix64 (long unsigned int x);
+static reuse_slot *findSlot (reuse_stat *st, long unsigned int block);
+static inline void treeAdd (reuse_stat *st, long unsigned int pos, int delta);
+static inline long unsigned int treeSum (const reuse_stat *st, long unsigned int pos);
+
+/* Whether a block falls into the spatial sample. */
+int
+reuseSampled (unsigned int lun, long unsigned int block, double rate)
+{
+  if (rate >= 1)
+    return 1;
+  return (mix64 (block ^ (long unsigned int) lun << 48) & 0xffffff) < rate * 0x1000000;
+}
+
+/* Prepare for up to CAP accesses. */
+void
+initReuse (reuse_stat *st, unsigned int lun, double rate, long unsigned int cap,
+           long int hour_base, unsigned int hour_num)
+{
+  long unsigned int slots = 2;
+
+  memset (st, 0, sizeof (reuse_stat));
+  st->lun = lun;
+  st->rate = rate;
+  st->hour_base = hour_base;
+  st->hour_num = hour_num;
+  st->hour_blocks = calloc (hour_num, sizeof (long unsigned int));
+  st->hour_accesses = calloc (hour_num, sizeof (long unsigned int));
+
+  /* Distinct blocks never exceed accesses, so the table stays at most half full. */
+  while (slots < cap * 2)
+    slots *= 2;
+  st->cap = cap;
+  st->tree = calloc (cap + 1, sizeof (unsigned int));
+  st->table = calloc (slots, sizeof (reuse_slot));
+  st->mask = slots - 1;
+}
+
+/* Account the next access. */
+void
+reuseAccess (reuse_stat *st, long unsigned int block, double time_stamp)
+{
+  reuse_slot *slot = findSlot (st, block);
+  long int hour = (long int) (time_stamp / 3600);
+  long unsigned int pos = ++st->pos;
+
+  st->accesses++;
+  if (slot->block == 0)
+    {
+      slot->block = block + 1;
+      st->cold++;
+    }
+  else
+    {
+      /* Blocks whose last access lies after this block's are the distinct ones
+         touched since: its LRU stack distance. */
+      long unsigned int dist = treeSum (st, pos - 1) - treeSum (st, slot->pos);
+
+      st->hist[histBucket ((long unsigned int) (dist / st->rate))]++;
+      treeAdd (st, slot->pos, -1);
+    }
+  treeAdd (st, pos, 1);
+
+  /* Working set: first access of the block within this hour. */
+  if (hour - st->hour_base >= 0 && hour - st->hour_base < st->hour_num)
+    {
+      st->hour_accesses[hour - st->hour_base]++;
+      if (slot->pos == 0 || slot->hour != hour)
+        st->hour_blocks[hour - st->hour_base]++;
+    }
+  slot->pos = pos;
+  slot->hour = hour;
+}
+
+/* Release the stack distance state. */
+void
+finishReuse (reuse_stat *st)
+{
+  free (st->tree);
+  free (st->table);
+  st->tree = NULL;
+  st->table = NULL;
+}
+
+/* Write the results, scaled back from their samples. */
+void
+writeReuse (const reuse_stat *st_arr, unsigned int lun_num, FILE *file)
+{
+  fprintf (file, "LUN,ACCESSES,BLOCKS\n");
+  for (unsigned int i = 0; i < lun_num; i++)
+    if (st_arr[i].accesses > 0)
+      fprintf (file, "%u,%.0f,%.0f\n", st_arr[i].lun, st_arr[i].accesses / st_arr[i].rate,
+               st_arr[i].cold / st_arr[i].rate);
+
+  /* Hit ratio of an LRU cache of about DISTANCE + 1 blocks. */
+  fprintf (file, "\nLUN,DISTANCE,COUNT,HIT_RATIO\n");
+  for (unsigned int i = 0; i < lun_num; i++)
+    {
+      long unsigned int seen = 0;
+
+      for (int j = 0; j < HIST_BUCKETS; j++)
+        if (st_arr[i].hist[j] > 0)
+          {
+            seen += st_arr[i].hist[j];
+            fprintf (file, "%u,%lu,%.0f,%.6f\n", st_arr[i].lun, histValue (j),
+                     st_arr[i].hist[j] / st_arr[i].rate, (double) seen / st_arr[i].accesses);
+          }
+    }
+
+  fprintf (file, "\nLUN,HOUR,ACCESSES,BLOCKS\n");
+  for (unsigned int i = 0; i < lun_num; i++)
+    for (unsigned int j = 0; j < st_arr[i].hour_num; j++)
+      if (st_arr[i].hour_accesses[j] > 0)
+        fprintf (file, "%u,%ld,%.0f,%.0f\n", st_arr[i].lun, (st_arr[i].hour_base + j) * 3600,
+                 st_arr[i].hour_accesses[j] / st_arr[i].rate,
+                 st_arr[i].hour_blocks[j] / st_arr[i].rate);
+}
+
+/* Release the results. */
+void
+freeReuse (reuse_stat *st)
+{
+  finishReuse (st);
+  free (st->hour_blocks);
+  free (st->hour_accesses);
+}
+
+/* Auxiliary function for finding the slot of a block, or the empty one it would take. */
+static reuse_slot *
+findSlot (reuse_stat *st, long unsigned int block)
+{
+  long unsigned int i = mix64 (block) & st->mask;
+
+  while (st->table[i].block != 0 && st->table[i].block != block + 1)
+    i = (i + 1) & st->mask;
+  return &st->table[i];
+}
+
+/* Auxiliary function for adding to a position of the Fenwick tree. */
+static inline void
+treeAdd (reuse_stat *st, long unsigned int pos, int delta)
+{
+  for (; pos <= st->cap; pos += pos & -pos)
+    st->tree[pos] += delta;
+}
+
+/* Auxiliary function for summing positions [1, POS] of the Fenwick tree. */
+static inline long unsigned int
+treeSum (const reuse_stat *st, long unsigned int pos)
+{
+  long unsigned int sum = 0;
+
+  for (; pos > 0; pos -= pos & -pos)
+    sum += st->tree[pos];
+  return sum;
+}
+
+/* Auxiliary function for hashing (splitmix64 finalizer). */
+static inline long unsigned int
+mix64 (long unsigned int x)
+{
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9UL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebUL;
+  return x ^ (x >> 31);
+}
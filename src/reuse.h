@@ -0,0 +1,61 @@
+/*
+ * Reuse distances (LRU stack distances) and working sets of one LUN's block accesses.
+ *
+ */
+
+#ifndef REUSE_H
+#define REUSE_H
+
+#include <stdio.h>
+#include "aggregate.h"
+
+/* Accesses are counted in blocks of this many bytes. */
+#define REUSE_BLOCK 4096
+
+/* Type definitions. */
+typedef struct                    // Type of a block slot of the last-access table.
+  {
+    long unsigned int block;        // Block + 1, 0 for empty.
+    long unsigned int pos;          // Position of its last access.
+    long int hour;                  // Hour of its last access.
+  } reuse_slot;
+typedef struct                    // Type of reuse statistics of one LUN.
+  {
+    unsigned int lun;
+    double rate;                    // Sampled share of blocks, 1 for exact.
+    long unsigned int accesses;     // Sampled block accesses.
+    long unsigned int cold;         // First accesses, i.e. distinct blocks.
+    long unsigned int hist[HIST_BUCKETS];   // Reuse distances in blocks, scaled back.
+    long int hour_base;
+    unsigned int hour_num;
+    long unsigned int *hour_blocks; // Distinct blocks of each hour.
+    long unsigned int *hour_accesses;
+
+    /* Stack distance state, released once done. */
+    long unsigned int cap, pos;
+    unsigned int *tree;             // Fenwick tree over positions of last accesses.
+    reuse_slot *table;              // Open-addressed, power of two slots.
+    long unsigned int mask;
+  } reuse_stat;
+
+/* Whether a block of a LUN falls into a spatial sample of RATE (SHARDS-style:
+ * a fixed hash subset of blocks, so every access of a sampled block is kept). */
+int reuseSampled (unsigned int lun, long unsigned int block, double rate);
+
+/* Prepare for up to CAP accesses, over hours [HOUR_BASE, HOUR_BASE + HOUR_NUM). */
+void initReuse (reuse_stat *st, unsigned int lun, double rate, long unsigned int cap,
+                long int hour_base, unsigned int hour_num);
+
+/* Account the next access in time order of a sampled block at a time stamp. */
+void reuseAccess (reuse_stat *st, long unsigned int block, double time_stamp);
+
+/* Release the stack distance state, keeping the results. */
+void finishReuse (reuse_stat *st);
+
+/* Write the results of LUN_NUM LUNs, scaled back from their samples. */
+void writeReuse (const reuse_stat *st_arr, unsigned int lun_num, FILE *file);
+
+/* Release the results. */
+void freeReuse (reuse_stat *st);
+
+#endif
@@ -0,0 +1,212 @@
+/*
+ * Fixed-size mergeable sketches: accounting, merging and summary writing.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sketch.h"
+
+static int countSize (sketch *sk, unsigned int size, long unsigned int cnt);
+static int cmpSlot (const void *a, const void *b);
+static inline long unsigned int mix64 (long unsigned int x);
+
+/* Reset a sketch to empty. */
+void
+initSketch (sketch *sk)
+{
+  memset (sk, 0, sizeof (sketch));
+  sk->ts_min = 1e300;
+}
+
+/* Account one entry. */
+void
+addSketch (sketch *sk, double time_stamp, long int response, unsigned int lun,
+           long unsigned int offset, unsigned int size)
+{
+  long unsigned int hash = mix64 (offset ^ (long unsigned int) lun << 48);
+  unsigned int reg = hash >> (64 - HLL_BITS);
+  unsigned char rank = __builtin_clzl ((hash << HLL_BITS) | (1UL << (HLL_BITS - 1))) + 1;
+
+  sk->num++;
+  sk->bytes += size;
+  if (time_stamp < sk->ts_min)
+    sk->ts_min = time_stamp;
+  if (time_stamp > sk->ts_max)
+    sk->ts_max = time_stamp;
+  if (!countSize (sk, size, 1))
+    sk->size_missed++;
+  sk->size_hist[histBucket (size)]++;
+  if (response >= 0)
+    {
+      sk->resp_num++;
+      sk->resp_hist[histBucket (response)]++;
+      if ((long unsigned int) response > sk->resp_max)
+        sk->resp_max = response;
+    }
+  sk->lun_cnt[lun < SKETCH_LUNS ? lun : SKETCH_LUNS - 1]++;
+  if (rank > sk->hll[reg])
+    sk->hll[reg] = rank;
+}
+
+/* Add SRC into DST. */
+void
+mergeSketch (sketch *dst, const sketch *src)
+{
+  dst->num += src->num;
+  dst->bytes += src->bytes;
+  if (src->ts_min < dst->ts_min)
+    dst->ts_min = src->ts_min;
+  if (src->ts_max > dst->ts_max)
+    dst->ts_max = src->ts_max;
+  for (unsigned int i = 0; i < SKETCH_SIZES; i++)
+    if (src->size_key[i] != 0 && !countSize (dst, src->size_key[i] - 1, src->size_cnt[i]))
+      dst->size_missed += src->size_cnt[i];
+  dst->size_missed += src->size_missed;
+  dst->resp_num += src->resp_num;
+  if (src->resp_max > dst->resp_max)
+    dst->resp_max = src->resp_max;
+  for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+      dst->size_hist[i] += src->size_hist[i];
+      dst->resp_hist[i] += src->resp_hist[i];
+    }
+  for (int i = 0; i < SKETCH_LUNS; i++)
+    dst->lun_cnt[i] += src->lun_cnt[i];
+  for (int i = 0; i < HLL_REGS; i++)
+    if (src->hll[i] > dst->hll[i])
+      dst->hll[i] = src->hll[i];
+}
+
+/* Estimated number of distinct (LUN, offset) pairs. */
+double
+hllEstimate (const sketch *sk)
+{
+  double sum = 0, estimate;
+  int zeros = 0;
+
+  for (int i = 0; i < HLL_REGS; i++)
+    {
+      sum += ldexp (1.0, -sk->hll[i]);
+      zeros += sk->hll[i] == 0;
+    }
+  estimate = 0.7213 / (1 + 1.079 / HLL_REGS) * HLL_REGS * HLL_REGS / sum;
+
+  /* Linear counting while many registers are still empty. */
+  if (estimate <= 2.5 * HLL_REGS && zeros > 0)
+    estimate = HLL_REGS * log ((double) HLL_REGS / zeros);
+
+  return estimate;
+}
+
+/* Write a summary of a read and a write sketch. */
+void
+writeSketches (const sketch *sk_r, const sketch *sk_w, FILE *file)
+{
+  const sketch *sk_arr[2] = {sk_r, sk_w};
+  long unsigned int total = sk_r->num + sk_w->num;
+
+  fprintf (file, "TYPE,COUNT,SHARE,BYTES,DISTINCT_OFFSETS,TS_MIN,TS_MAX\n");
+  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+    fprintf (file, "%c,%lu,%.4f,%lu,%.0f,%.6f,%.6f\n", mode_idx == 0 ? 'R' : 'W',
+             sk_arr[mode_idx]->num, total ? (double) sk_arr[mode_idx]->num / total : 0,
+             sk_arr[mode_idx]->bytes, hllEstimate (sk_arr[mode_idx]),
+             sk_arr[mode_idx]->num ? sk_arr[mode_idx]->ts_min : 0, sk_arr[mode_idx]->ts_max);
+
+  fprintf (file, "\nTYPE,RESPONSES,P50,P90,P99,P999,MAX\n");
+  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+    {
+      const sketch *sk = sk_arr[mode_idx];
+
+      fprintf (file, "%c,%lu,%.9f,%.9f,%.9f,%.9f,%.9f\n", mode_idx == 0 ? 'R' : 'W',
+               sk->resp_num, histPercentile (sk->resp_hist, sk->resp_num, 0.50) / 1e9,
+                             histPercentile (sk->resp_hist, sk->resp_num, 0.90) / 1e9,
+                             histPercentile (sk->resp_hist, sk->resp_num, 0.99) / 1e9,
+                             histPercentile (sk->resp_hist, sk->resp_num, 0.999) / 1e9,
+                             sk->resp_max / 1e9);
+    }
+
+  fprintf (file, "\nTYPE,LUN,COUNT\n");
+  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+    for (int i = 0; i < SKETCH_LUNS; i++)
+      if (sk_arr[mode_idx]->lun_cnt[i] > 0)
+        fprintf (file, "%c,%d%s,%lu\n", mode_idx == 0 ? 'R' : 'W', i,
+                 i == SKETCH_LUNS - 1 ? "+" : "", sk_arr[mode_idx]->lun_cnt[i]);
+
+  /* Exact size counts while the table held every size, log buckets otherwise. */
+  fprintf (file, "\nTYPE,SIZE,COUNT\n");
+  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+    {
+      const sketch *sk = sk_arr[mode_idx];
+
+      if (sk->size_missed == 0)
+        {
+          unsigned int slots[SKETCH_SIZES], slot_num = 0;
+
+          for (unsigned int i = 0; i < SKETCH_SIZES; i++)
+            if (sk->size_key[i] != 0)
+              slots[slot_num++] = sk->size_key[i] - 1;
+          qsort (slots, slot_num, sizeof (unsigned int), cmpSlot);
+          for (unsigned int i = 0; i < slot_num; i++)
+            {
+              unsigned int size = slots[i], j = mix64 (size) % SKETCH_SIZES;
+
+              while (sk->size_key[j] != size + 1)
+                j = (j + 1) % SKETCH_SIZES;
+              fprintf (file, "%c,%u,%lu\n", mode_idx == 0 ? 'R' : 'W', size, sk->size_cnt[j]);
+            }
+        }
+      else
+        for (int i = 0; i < HIST_BUCKETS; i++)
+          if (sk->size_hist[i] > 0)
+            fprintf (file, "%c,~%lu,%lu\n", mode_idx == 0 ? 'R' : 'W', histValue (i),
+                     sk->size_hist[i]);
+    }
+}
+
+/* Auxiliary function for counting a size in the exact table; returns 0 when full. */
+static int
+countSize (sketch *sk, unsigned int size, long unsigned int cnt)
+{
+  unsigned int i = mix64 (size) % SKETCH_SIZES;
+
+  /* The table stays at most 3/4 full, so every probe ends at an empty slot. */
+  while (sk->size_key[i] != 0)
+    {
+      if (sk->size_key[i] == size + 1)
+        {
+          sk->size_cnt[i] += cnt;
+          return 1;
+        }
+      i = (i + 1) % SKETCH_SIZES;
+    }
+  if (sk->size_used < SKETCH_SIZES / 4 * 3)
+    {
+      sk->size_key[i] = size + 1;
+      sk->size_cnt[i] = cnt;
+      sk->size_used++;
+      return 1;
+    }
+
+  return 0;
+}
+
+/* Auxiliary function for sorting sizes. */
+static int
+cmpSlot (const void *a, const void *b)
+{
+  unsigned int x = *(const unsigned int *) a, y = *(const unsigned int *) b;
+
+  return (x > y) - (x < y);
+}
+
+/* Auxiliary function for hashing (splitmix64 finalizer). */
+static inline long unsigned int
+mix64 (long unsigned int x)
+{
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9UL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebUL;
+  return x ^ (x >> 31);
+}
@@ -0,0 +1,53 @@
+/*
+ * Fixed-size mergeable sketches of trace entries, for approximate statistics.
+ *
+ */
+
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <stdio.h>
+#include "aggregate.h"
+
+/* Sketch bounds; a sketch never grows past these. */
+#define SKETCH_SIZES 1024     // Size table slots; up to 3/4 of them hold sizes counted
+                              // exactly, later sizes only land in buckets.
+#define SKETCH_LUNS 64        // LUNs counted, larger ones fold into the last.
+#define HLL_BITS 14           // HyperLogLog registers (2^14, about 0.8% error).
+#define HLL_REGS (1 << HLL_BITS)
+
+/* Type definitions. */
+typedef struct                    // Type of a sketch of one IO type.
+  {
+    long unsigned int num;
+    long unsigned int bytes;
+    double ts_min, ts_max;
+    unsigned int size_key[SKETCH_SIZES];          // Open-addressed, size + 1, 0 for empty.
+    long unsigned int size_cnt[SKETCH_SIZES];
+    unsigned int size_used;
+    long unsigned int size_missed;                // Entries of sizes the table could not hold.
+    long unsigned int size_hist[HIST_BUCKETS];    // Every size, log-bucketed.
+    long unsigned int resp_num;
+    long unsigned int resp_max;
+    long unsigned int resp_hist[HIST_BUCKETS];    // Response in nanoseconds, log-bucketed.
+    long unsigned int lun_cnt[SKETCH_LUNS];
+    unsigned char hll[HLL_REGS];                  // Distinct (LUN, offset) pairs.
+  } sketch;
+
+/* Reset a sketch to empty. */
+void initSketch (sketch *sk);
+
+/* Account one entry; RESPONSE is in nanoseconds or negative when empty. */
+void addSketch (sketch *sk, double time_stamp, long int response, unsigned int lun,
+                long unsigned int offset, unsigned int size);
+
+/* Add SRC into DST. */
+void mergeSketch (sketch *dst, const sketch *src);
+
+/* Estimated number of distinct (LUN, offset) pairs. */
+double hllEstimate (const sketch *sk);
+
+/* Write a summary of a read and a write sketch. */
+void writeSketches (const sketch *sk_r, const sketch *sk_w, FILE *file);
+
+#endif
@@ -0,0 +1,2218 @@
+/*
+ * Embeddable trace sorting library: ingest, sort, size counting and writing.
+ *
+ */
+
+#define _GNU_SOURCE           // For `copy_file_range'.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <omp.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "tracesort.h"
+#include "index.h"
+#include "aggregate.h"
+#include "fdpool.h"
+#include "gzframe.h"
+#include "reuse.h"
+#include "tune.h"
+
+#pragma GCC diagnostic ignored "-Wunused-result"  // Shutdown unused warnings for `fscanf'.
+
+/* Predefined constants. */
+#define NAME_LENGTH_MAX 256   // Max length of a file name.
+#define R_IDX TS_READ         // File index of R.csv.
+#define W_IDX TS_WRITE        // File index of W.csv.
+#define INST_LINE "Timestamp,Response,IOType,LUN,Offset,Size\n"
+#define GATHER_BUF_SIZE 1048576   // Per-thread buffer of gathered lines.
+#define COPY_RUN_MIN 4096         // Contiguous source runs this long are copied kernel-side.
+#define PRUNE_SLACK 60            // Seconds an hourly source file may spill over its hour.
+#define COLUMNS_MAX 16            // Columns looked at in a line of a given layout.
+#define FILETIME_EPOCH 116444736000000000UL   // Windows file time of the Unix epoch.
+
+/* Sort instances, by key. */
+#define SORT_SIZE_TIME 0
+#define SORT_TIME_SIZE 1
+#define SORT_KEYS 2
+
+/* Pipeline stages reached. */
+#define STAGE_NONE 0
+#define STAGE_SCANNED 1
+#define STAGE_READ 2
+#define STAGE_SORTED 3
+
+/* Type definitions. */
+typedef struct                    // Type of an entry node (32 bytes, no padding).
+  {
+    double time_stamp;
+    long unsigned int offset;
+    long unsigned int write_offset;
+    unsigned int size;
+    unsigned int src_file_idx;
+  } node;
+typedef struct                    // Type of size count slot.
+  {
+    unsigned int size;
+    long unsigned int cnt;
+  } cnt_struct;
+typedef struct                    // Type of a trace source.
+  {
+    char *name;                     // Path of a file source, NULL for in-memory ones.
+    const char *data;               // Bytes of an in-memory source.
+    long unsigned int len;
+    int owned;                      // SRC_BORROWED, SRC_MALLOCED or SRC_MAPPED.
+  } ts_source;
+typedef struct                    // Type of a per-thread gathering buffer.
+  {
+    char *data;
+    long unsigned int len;
+    long unsigned int off;          // Result offset of data[0], uncompressed.
+    int fd;
+    gz_stream *gz;                  // Compress into frames instead, if set.
+    int level;
+    int failed;                     // A write to fd fell short.
+  } gather_buf;
+typedef struct                    // Type of an IO location, for the LUN view.
+  {
+    long unsigned int offset;
+    unsigned int lun;
+  } io_loc;
+typedef struct                    // Type of a line of a view (16 bytes).
+  {
+    long unsigned int offset;
+    unsigned int src_file_idx;
+    unsigned int len;
+  } line_ref;
+typedef struct                    // Type of the records a view permutation sorts.
+  {
+    const node *arr;
+    const io_loc *loc;
+  } view_key;
+typedef struct                    // Type of a record of one LUN in time order.
+  {
+    double time_stamp;
+    long unsigned int slot;         // Node slot, IO type in the top bit.
+  } access_ref;
+typedef struct                    // Type of a set of distinct sizes.
+  {
+    long unsigned int *slots;       // Open-addressed, size + 1 or 0 for empty.
+    unsigned int num, mask;
+  } size_set;
+typedef struct                    // Type of an output shard.
+  {
+    int mode_idx;
+    unsigned int idx;
+    long unsigned int start, end;   // Entries [start, end).
+    long unsigned int bytes;        // File size once written.
+  } shard;
+struct ts_ctx                     // Type of a sorting context.
+  {
+    ts_options opts;
+    tune_phase tune[TS_PHASES];     // Parallel degree of each phase, kept across tsReset.
+    int stage;
+    int placed;                     // Write offsets accumulated.
+    int sorter;                     // SORT_* instance of the sort key.
+    const char *header;             // Line leading every result, may be empty.
+    unsigned int header_len;
+
+    /* Sources. */
+    ts_source *srcs;
+    unsigned int src_num, src_cap;
+
+    /* Scanned statistics. */
+    long unsigned int *num_arr[2];  // Number of entries in each source.
+    long unsigned int num[2];       // Number of entries of read / write.
+    unsigned int cnt[2];            // Number of different sizes of read / write.
+    double ts_min, ts_max;          // Range of time stamps.
+    long unsigned int long_num;     // Lines skipped for exceeding TS_LINE_MAX.
+    unsigned int lun_max;           // Largest LUN index met.
+
+    /* Containers. */
+    cnt_struct *size_cnt_arr[2];    // Array of size count data.
+    node *node_arr[2];              // Huge node arrays.
+    long unsigned int node_cap[2];  // Nodes they hold, kept across tsReset.
+    unsigned int *slot_size[2];     // Distinct sizes in ascending order.
+    aggregate agg_arr[2];           // Merged aggregates.
+    io_loc *loc_arr[2];             // IO locations by node slot (LUN view only).
+    line_ref *view_arr[2][TS_VIEWS];  // Lines of each extra view, in its order.
+    long unsigned int view_num[2];  // Lines of every view of an IO type.
+    reuse_stat *reuse_arr;          // Reuse statistics per LUN.
+    unsigned int reuse_num;
+    char dst_name[2][NAME_LENGTH_MAX];
+  };
+
+/* Names of extra views, by view bit. */
+static const char *view_names[TS_VIEWS] = {"lun", "time"};
+
+/* Names of tuned phases, by TS_PHASE_*. */
+static const char *phase_names[TS_PHASES] = {"unzip", "scan", "read", "sort", "write"};
+
+/* Stream window: chunks filled ahead of the one being emitted, per thread. */
+#define STREAM_AHEAD 2
+
+/* Source ownership. */
+#define SRC_BORROWED 0
+#define SRC_MALLOCED 1
+#define SRC_MAPPED 2
+
+/* Subroutine definitions. */
+static void initContext (ts_ctx *ctx, const ts_options *opts);
+static void clearContext (ts_ctx *ctx);
+static tune_phase *startPhase (ts_ctx *ctx, int phase, unsigned int items);
+static int addSource (ts_ctx *ctx, char *name, const char *data, long unsigned int len,
+                      int owned);
+static FILE *openSource (const ts_source *src);
+static long unsigned int skipHeader (FILE *src_file, const ts_schema *schema);
+static inline int parseEntry (const ts_schema *schema, const char *line, ts_entry *e);
+static int parseColumns (const ts_schema *schema, const char *line, ts_entry *e);
+static void placeEntries (ts_ctx *ctx);
+static void buildViews (ts_ctx *ctx);
+static int cmpLunView (const void *a, const void *b, void *arg);
+static int cmpTimeView (const void *a, const void *b, void *arg);
+static void analyzeReuse (ts_ctx *ctx);
+static int cmpAccess (const void *a, const void *b);
+static fd_pool *newSourcePool (ts_ctx *ctx);
+static int writeShards (ts_ctx *ctx, fd_pool *src_pool);
+static int emitChunk (int fd, const char *chunk, long unsigned int len, int *use_splice);
+static int writeIndex (ts_ctx *ctx, int mode_idx);
+static int writeAggregateFile (ts_ctx *ctx, int mode_idx);
+static int writeReuseFile (ts_ctx *ctx);
+static int writeView (ts_ctx *ctx, fd_pool *src_pool, int mode_idx, int view);
+static int closeFile (FILE *file);
+static void writeLines (ts_ctx *ctx, fd_pool *src_pool, gather_buf *gb, node *arr,
+                        long unsigned int start, long unsigned int end);
+static void writeRun (ts_ctx *ctx, fd_pool *src_pool, gather_buf *gb, unsigned int src_idx,
+                      long unsigned int src_off, long unsigned int len);
+static void flushGather (gather_buf *gb);
+static void appendGather (gather_buf *gb, const char *bytes, long unsigned int len);
+static void gatherRun (gather_buf *gb, const ts_source *src, int src_fd, off_t src_off,
+                       long unsigned int len);
+static int copyRun (int src_fd, off_t src_off, int dst_fd, off_t dst_off, size_t len,
+                    char *bounce);
+static void addSize (size_set *set, unsigned int size);
+static void mergeSizes (size_set *dst, const size_set *src);
+static unsigned int *sortSizes (const size_set *set);
+static int cmpSize (const void *a, const void *b);
+static inline unsigned int sizeSlot (const unsigned int *slot_size, unsigned int cnt,
+                                     unsigned int size);
+static inline int keepEntry (const ts_options *opts, int mode_idx, double time_stamp,
+                             unsigned int lun, unsigned int size);
+static inline void swap (node *a, node *b);
+static inline int larger (node *a, node *b);
+static inline int largerByTime (node *a, node *b);
+static inline int largerByKeys (node *a, node *b, const int *keys);
+
+/* Selection and heap sort instances, with their comparators inlined. */
+#define NODE_SORT SizeTime
+#define NODE_LARGER(a, b, keys) larger (a, b)
+#include "nodesort.h"
+#define NODE_SORT TimeSize
+#define NODE_LARGER(a, b, keys) largerByTime (a, b)
+#include "nodesort.h"
+#define NODE_SORT Keys
+#define NODE_LARGER(a, b, keys) largerByKeys (a, b, keys)
+#include "nodesort.h"
+
+static void (*const select_fns[3]) (node *, long unsigned int, long unsigned int,
+                                    long unsigned int, const int *)
+  = {selectNodesSizeTime, selectNodesTimeSize, selectNodesKeys};
+static void (*const sort_fns[3]) (node *, long unsigned int, const int *)
+  = {heapSortSizeTime, heapSortTimeSize, heapSortKeys};
+
+/* Create a context. */
+ts_ctx *
+tsCreate (const ts_options *opts)
+{
+  ts_ctx *ctx = calloc (1, sizeof (ts_ctx));
+
+  initContext (ctx, opts);
+  return ctx;
+}
+
+/* Reuse a context for another trace. */
+void
+tsReset (ts_ctx *ctx, const ts_options *opts)
+{
+  node *node_arr[2] = {ctx->node_arr[R_IDX], ctx->node_arr[W_IDX]};
+  long unsigned int node_cap[2] = {ctx->node_cap[R_IDX], ctx->node_cap[W_IDX]};
+  tune_phase tune[TS_PHASES];
+
+  memcpy (tune, ctx->tune, sizeof (tune));
+  clearContext (ctx);
+  memset (ctx, 0, sizeof (ts_ctx));
+  memcpy (ctx->tune, tune, sizeof (tune));
+  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+    {
+      ctx->node_arr[mode_idx] = node_arr[mode_idx];
+      ctx->node_cap[mode_idx] = node_cap[mode_idx];
+    }
+  initContext (ctx, opts);
+}
+
+/* Release a context and every source it owns. */
+void
+tsDestroy (ts_ctx *ctx)
+{
+  clearContext (ctx);
+  free (ctx->node_arr[R_IDX]);
+  free (ctx->node_arr[W_IDX]);
+  free (ctx);
+}
+
+/* Auxiliary function for setting up a zeroed context from options. */
+static void
+initContext (ts_ctx *ctx, const ts_options *opts)
+{
+  if (opts != NULL)
+    ctx->opts = *opts;
+  if (ctx->opts.out_dir == NULL)
+    ctx->opts.out_dir = "output";
+
+  /* Default key, and the sort instance it gets. */
+  if (ctx->opts.sort_key[0] == 0)
+    {
+      ctx->opts.sort_key[0] = TS_KEY_SIZE;
+      ctx->opts.sort_key[1] = TS_KEY_TIME;
+    }
+  if (ctx->opts.sort_key[0] == TS_KEY_SIZE && ctx->opts.sort_key[1] == TS_KEY_TIME)
+    ctx->sorter = SORT_SIZE_TIME;
+  else if (ctx->opts.sort_key[0] == TS_KEY_TIME && ctx->opts.sort_key[1] == TS_KEY_SIZE)
+    ctx->sorter = SORT_TIME_SIZE;
+  else
+    ctx->sorter = SORT_KEYS;
+
+  ctx->header = ctx->opts.schema.format == TS_FORMAT_SYSTOR ? INST_LINE : "";
+  ctx->header_len = strlen (ctx->header);
+}
+
+/* Auxiliary function for setting up the controller of a phase before it runs: from
+   the processor count, and for phases over ITEMS sources (if any) from two of them
+   per thread, up to twice the processors (I/O waits) or one source per thread; sort
+   stays within the processors. Degrees set in the options are kept as they are. */
+static tune_phase *
+startPhase (ts_ctx *ctx, int phase, unsigned int items)
+{
+  unsigned int procs = omp_get_num_procs ();
+  unsigned int start = procs, max = phase == TS_PHASE_SORT ? procs : 2 * procs;
+  unsigned int fixed = ctx->opts.phase_threads[phase] ? ctx->opts.phase_threads[phase]
+                                                      : ctx->opts.threads;
+
+  if (items > 0 && start > items / 2)
+    start = items / 2;
+  if (items > 0 && max > items)
+    max = items;
+  initTune (&ctx->tune[phase], phase_names[phase], start, max, fixed);
+
+  return &ctx->tune[phase];
+}
+
+/* Auxiliary function for releasing sources and every container but the node arrays. */
+static void
+clearContext (ts_ctx *ctx)
+{
+  for (unsigned int i = 0; i < ctx->src_num; i++)
+    {
+      free (ctx->srcs[i].name);
+      if (ctx->srcs[i].owned == SRC_MALLOCED)
+        free ((char *) ctx->srcs[i].data);
+      else if (ctx->srcs[i].owned == SRC_MAPPED)
+        munmap ((char *) ctx->srcs[i].data, ctx->srcs[i].len);
+    }
+  free (ctx->srcs);
+
+  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+    {
+      free (ctx->num_arr[mode_idx]);
+      free (ctx->size_cnt_arr[mode_idx]);
+      free (ctx->slot_size[mode_idx]);
+      free (ctx->loc_arr[mode_idx]);
+      for (int view = 0; view < TS_VIEWS; view++)
+        free (ctx->view_arr[mode_idx][view]);
+      if (ctx->opts.agg_mask && ctx->stage >= STAGE_SCANNED)
+        freeAggregate (&ctx->agg_arr[mode_idx]);
+    }
+  for (unsigned int lun = 0; lun < ctx->reuse_num; lun++)
+    freeReuse (&ctx->reuse_arr[lun]);
+  free (ctx->reuse_arr);
+}
+
+/* Add a trace CSV file by path. */
+int
+tsAddFile (ts_ctx *ctx, const char *path)
+{
+  return addSource (ctx, strdup (path), NULL, 0, SRC_BORROWED);
+}
+
+/* Whether a source file name may hold entries passing the predicates. */
+int
+tsMayMatch (const ts_options *opts, const char *path)
+{
+  const char *base = strrchr (path, '/') ? strrchr (path, '/') + 1 : path;
+  struct tm tm = {0};
+  unsigned int lun;
+  double hour;
+
+  /* Names are `YYYYMMDDHH-LUN<n>.csv', others are always kept. */
+  if (sscanf (base, "%4d%2d%2d%2d-LUN%u", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour,
+              &lun) != 5)
+    return 1;
+  if (opts->lun_mask != 0 && (lun >= 64 || !(opts->lun_mask & 1UL << lun)))
+    return 0;
+
+  /* A file holds its hour of entries, give or take a boundary slack. */
+  tm.tm_year -= 1900;
+  tm.tm_mon -= 1;
+  hour = timegm (&tm);
+  if (opts->ts_to != 0 && hour - PRUNE_SLACK >= opts->ts_to)
+    return 0;
+  if (hour + 3600 + PRUNE_SLACK <= opts->ts_from)
+    return 0;
+
+  return 1;
+}
+
+/* Parse a trace layout. */
+int
+tsParseSchema (const char *spec, ts_schema *schema)
+{
+  char *copy, *pair;
+  int ret = 0;
+
+  memset (schema, 0, sizeof (ts_schema));
+  if (strcmp (spec, "systor") == 0)
+    return 0;
+  schema->format = strcmp (spec, "msr") == 0 ? TS_FORMAT_MSR
+                   : strcmp (spec, "alibaba") == 0 ? TS_FORMAT_ALIBABA : TS_FORMAT_COLUMNS;
+  if (schema->format != TS_FORMAT_COLUMNS)
+    return 0;
+
+  /* Columns given one by one, all but the response required. */
+  schema->ts = schema->type = schema->lun = schema->offset = schema->size = schema->resp = -1;
+  schema->ts_unit = schema->resp_unit = 1;
+  copy = strdup (spec);
+  for (pair = strtok (copy, ","); pair != NULL && ret == 0; pair = strtok (NULL, ","))
+    {
+      char *value = strchr (pair, '=');
+      int col;
+
+      if (value == NULL)
+        {
+          ret = -1;
+          break;
+        }
+      *value++ = '\0';
+      col = atoi (value);
+      if (strcmp (pair, "ts") == 0)
+        schema->ts = col;
+      else if (strcmp (pair, "resp") == 0)
+        schema->resp = col;
+      else if (strcmp (pair, "type") == 0)
+        schema->type = col;
+      else if (strcmp (pair, "lun") == 0)
+        schema->lun = col;
+      else if (strcmp (pair, "offset") == 0)
+        schema->offset = col;
+      else if (strcmp (pair, "size") == 0)
+        schema->size = col;
+      else if (strcmp (pair, "ts_unit") == 0)
+        schema->ts_unit = atof (value);
+      else if (strcmp (pair, "ts_epoch") == 0)
+        schema->ts_epoch = atof (value);
+      else if (strcmp (pair, "resp_unit") == 0)
+        schema->resp_unit = atof (value);
+      else
+        ret = -1;
+    }
+  free (copy);
+  if (schema->ts < 0 || schema->type < 0 || schema->lun < 0 || schema->offset < 0
+      || schema->size < 0)
+    ret = -1;
+
+  return ret;
+}
+
+/* Parse a sort key. */
+int
+tsParseSortKey (const char *spec, int *keys)
+{
+  char *copy = strdup (spec);
+  int key_num = 0, ret = 0;
+
+  memset (keys, 0, sizeof (int) * TS_KEYS);
+  for (char *field = strtok (copy, ","); field != NULL; field = strtok (NULL, ","))
+    {
+      int desc = field[0] == '-', key = strcmp (field + desc, "size") == 0 ? TS_KEY_SIZE
+                                        : strcmp (field + desc, "time") == 0 ? TS_KEY_TIME : 0;
+
+      if (key == 0 || key_num == TS_KEYS)
+        {
+          ret = -1;
+          break;
+        }
+      keys[key_num++] = desc ? -key : key;
+    }
+  free (copy);
+  if (key_num == 0 || (key_num == 2 && (keys[0] == keys[1] || keys[0] == -keys[1])))
+    ret = -1;
+
+  return ret;
+}
+
+/* Parse parallel degrees. */
+int
+tsParseThreads (const char *spec, ts_options *opts)
+{
+  char *copy = strdup (spec);
+  int ret = 0;
+
+  for (char *pair = strtok (copy, ","); pair != NULL; pair = strtok (NULL, ","))
+    {
+      char *value = strchr (pair, '=');
+      int phase = 0;
+
+      /* A bare number sets every phase not named. */
+      if (value == NULL)
+        {
+          if (atoi (pair) < 1)
+            ret = -1;
+          else
+            opts->threads = atoi (pair);
+          continue;
+        }
+      *value++ = '\0';
+      while (phase < TS_PHASES && strcmp (pair, phase_names[phase]) != 0)
+        phase++;
+      if (phase == TS_PHASES || atoi (value) < 1)
+        ret = -1;
+      else
+        opts->phase_threads[phase] = atoi (value);
+    }
+  free (copy);
+
+  return ret;
+}
+
+/* Parse an entry line. */
+int
+tsParseLine (const ts_schema *schema, const char *line, ts_entry *e)
+{
+  return parseEntry (schema, line, e);
+}
+
+/* Add trace CSV text from memory, without copying. */
+int
+tsAddBuffer (ts_ctx *ctx, const char *buf, long unsigned int len)
+{
+  return addSource (ctx, NULL, buf, len, SRC_BORROWED);
+}
+
+/* Add trace CSV text from a descriptor. */
+int
+tsAddFd (ts_ctx *ctx, int fd)
+{
+  struct stat st;
+  char *data;
+  long unsigned int len = 0, cap = GATHER_BUF_SIZE;
+  ssize_t done;
+
+  if (fstat (fd, &st) != 0)
+    return -1;
+
+  /* Regular files are mapped in place. */
+  if (S_ISREG (st.st_mode))
+    {
+      if (st.st_size == 0)
+        return addSource (ctx, NULL, "", 0, SRC_BORROWED);
+      data = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED)
+        return -1;
+      return addSource (ctx, NULL, data, st.st_size, SRC_MAPPED);
+    }
+
+  /* Pipes and sockets are read to the end. */
+  data = malloc (cap);
+  while ((done = read (fd, data + len, cap - len)) > 0)
+    if ((len += done) == cap)
+      data = realloc (data, cap *= 2);
+  if (done < 0)
+    {
+      free (data);
+      return -1;
+    }
+  return addSource (ctx, NULL, data, len, SRC_MALLOCED);
+}
+
+/* Statistics collecting stage. */
+int
+tsScanStatistics (ts_ctx *ctx)
+{
+  size_set sizes[2] = {{NULL, 0, 0}, {NULL, 0, 0}};
+  long unsigned int R_num_tmp = 0, W_num_tmp = 0, long_num = 0;
+  double ts_min = 1e300, ts_max = 0;
+  unsigned int lun_max = 0;
+  tune_phase *tp;
+
+  if (ctx->stage >= STAGE_SCANNED)
+    return 0;
+  if (ctx->src_num == 0)
+    return -1;
+
+  tp = startPhase (ctx, TS_PHASE_SCAN, ctx->src_num);
+  ctx->num_arr[R_IDX] = calloc (ctx->src_num, sizeof (long unsigned int));
+  ctx->num_arr[W_IDX] = calloc (ctx->src_num, sizeof (long unsigned int));
+
+  /* Scan in rounds, the first ones probing parallel degrees. */
+  for (unsigned int next = 0, round; next < ctx->src_num; next += round)
+    {
+      long unsigned int bytes = 0;
+
+      round = tuneBegin (tp, ctx->src_num - next, ctx->src_num);
+
+      /* Use OpenMP for paralleled statistics scanning. */
+      #pragma omp parallel num_threads(tp->degree) \
+                           reduction(+:R_num_tmp, W_num_tmp, long_num, bytes) \
+                           reduction(min:ts_min) reduction(max:ts_max, lun_max)
+        {
+          size_set local[2] = {{NULL, 0, 0}, {NULL, 0, 0}};   // Sizes this thread met.
+
+          #pragma omp for schedule(dynamic)
+          for (unsigned int i = next; i < next + round; i++)  // Each thread has several
+            {                                                 // independent source files.
+              FILE *src_file = openSource (&ctx->srcs[i]);
+              char *line = NULL;
+              size_t line_cap = 0;
+              ssize_t len;
+              unsigned int size, mode_idx, lun;
+              double time_stamp;
+              ts_entry e;
+
+              if (src_file == NULL)
+                continue;
+
+              /* Scan each trace entry, whole lines so that none is split. */
+              skipHeader (src_file, &ctx->opts.schema);   // Abandon the instruction line.
+              while ((len = getline (&line, &line_cap, src_file)) > 0)
+                {
+                  /* Longer lines would not fit the result buffers. */
+                  if (len + (line[len - 1] != '\n') > TS_LINE_MAX)
+                    {
+                      long_num++;
+                      continue;
+                    }
+
+                  /* Extract informations. */
+                  if (!parseEntry (&ctx->opts.schema, line, &e))
+                    continue;
+                  time_stamp = e.time_stamp;
+                  mode_idx = e.mode;
+                  lun = e.lun;
+                  size = e.size;
+                  if (!keepEntry (&ctx->opts, mode_idx, time_stamp, lun, size))
+                    continue;
+
+                  /* Update statistics. */
+                  if (mode_idx == R_IDX)
+                    R_num_tmp++;
+                  else
+                    W_num_tmp++;
+                  if (time_stamp < ts_min)
+                    ts_min = time_stamp;
+                  if (time_stamp > ts_max)
+                    ts_max = time_stamp;
+                  if (lun > lun_max)
+                    lun_max = lun;
+                  addSize (&local[mode_idx], size);
+                  ctx->num_arr[mode_idx][i]++;
+                }
+              bytes += ftell (src_file);
+              free (line);
+              fclose (src_file);              // Reopened by later stages, keeps open files bounded.
+            }
+
+          /* Merge thread-local size sets. */
+          #pragma omp critical
+          for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+            mergeSizes (&sizes[mode_idx], &local[mode_idx]);
+          free (local[R_IDX].slots);
+          free (local[W_IDX].slots);
+        }
+      tuneEnd (tp, bytes);
+    }
+  ctx->num[R_IDX] = R_num_tmp;
+  ctx->num[W_IDX] = W_num_tmp;
+  ctx->long_num = long_num;
+  ctx->ts_min = ts_min;
+  ctx->ts_max = ts_max;
+  ctx->lun_max = lun_max;
+
+  /* Acquire different sizes, numbered in ascending order for the aggregates. */
+  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+    {
+      ctx->cnt[mode_idx] = sizes[mode_idx].num;
+      ctx->slot_size[mode_idx] = sortSizes (&sizes[mode_idx]);
+      free (sizes[mode_idx].slots);
+      if (ctx->opts.agg_mask)
+        initAggregate (&ctx->agg_arr[mode_idx], ctx->opts.agg_mask, lun_max + 1,
+                       (long int) (ts_min / 3600),
+                       (long int) (ts_max / 3600) - (long int) (ts_min / 3600) + 1,
+                       ctx->cnt[mode_idx], ctx->slot_size[mode_idx]);
+    }
+
+  /* Allocate memory space for huge node arrays (unless left large enough by an
+     earlier trace) and size count arrays. */
+  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+    {
+      if (ctx->node_cap[mode_idx] < ctx->num[mode_idx] + 1)
+        {
+          free (ctx->node_arr[mode_idx]);
+          ctx->node_cap[mode_idx] = ctx->num[mode_idx] + 1;
+          ctx->node_arr[mode_idx] = malloc (sizeof (node) * ctx->node_cap[mode_idx]);
+        }
+      if (ctx->opts.views & TS_VIEW_LUN || ctx->opts.reuse_rate > 0)
+        ctx->loc_arr[mode_idx] = malloc (sizeof (io_loc) * (ctx->num[mode_idx] + 1));
+      ctx->size_cnt_arr[mode_idx] = calloc (ctx->cnt[mode_idx] + 1, sizeof (cnt_struct));
+    }
+
+  ctx->stage = STAGE_SCANNED;
+  return 0;
+}
+
+/* Abstraction read stage. */
+int
+tsAbstractRead (ts_ctx *ctx)
+{
+  long unsigned int *slot_idx_arr[2];
+  unsigned int src_num = ctx->src_num;
+  tune_phase *tp;
+
+  if (ctx->stage >= STAGE_READ)
+    return 0;
+  if (ctx->stage < STAGE_SCANNED && tsScanStatistics (ctx) != 0)
+    return -1;
+
+  /* Accumulate the slot indexes that each file starts. */
+  slot_idx_arr[R_IDX] = calloc (src_num, sizeof (long unsigned int));
+  slot_idx_arr[W_IDX] = calloc (src_num, sizeof (long unsigned int));
+  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+    for (unsigned int i = 1; i < src_num; i++)
+      slot_idx_arr[mode_idx][i] = slot_idx_arr[mode_idx][i - 1] + ctx->num_arr[mode_idx][i - 1];
+
+  /* Read in rounds, the first ones probing parallel degrees. */
+  tp = startPhase (ctx, TS_PHASE_READ, src_num);
+  for (unsigned int next = 0, round; next < src_num; next += round)
+    {
+      long unsigned int bytes = 0;
+
+      round = tuneBegin (tp, src_num - next, src_num);
+
+      /* Use OpenMP for paralleled reading. */
+      #pragma omp parallel num_threads(tp->degree) reduction(+:bytes)
+        {
+          int agg_mask = ctx->opts.agg_mask;
+          aggregate local_agg[2];
+
+          /* Thread-local accumulators, merged after the scan. */
+          if (agg_mask)
+            for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+              initAggregate (&local_agg[mode_idx], agg_mask, ctx->agg_arr[mode_idx].lun_num,
+                             ctx->agg_arr[mode_idx].hour_base, ctx->agg_arr[mode_idx].hour_num,
+                             ctx->cnt[mode_idx], ctx->slot_size[mode_idx]);
+
+          /* Read and create nodes. */
+          #pragma omp for schedule(dynamic)
+          for (unsigned int i = next; i < next + round; i++)  // Each thread has several
+            {                                                 // independent source files.
+              FILE *src_file = openSource (&ctx->srcs[i]);
+              long unsigned int slot_idx[2] = {slot_idx_arr[R_IDX][i], slot_idx_arr[W_IDX][i]};
+              long unsigned int offset, io_offset;
+              char *line = NULL;
+              size_t line_cap = 0;
+              ssize_t len;
+              unsigned int size, mode_idx, lun;
+              double time_stamp, response;
+              ts_entry e;
+
+              if (src_file == NULL)
+                continue;
+
+              /* Scan each trace entry; offsets advance by whole lines, skipped or not. */
+              offset = skipHeader (src_file, &ctx->opts.schema);  // Abandon the instruction line.
+              for (; (len = getline (&line, &line_cap, src_file)) > 0; offset += len)
+                {
+                  /* Extract informations. */
+                  if (len + (line[len - 1] != '\n') > TS_LINE_MAX
+                      || !parseEntry (&ctx->opts.schema, line, &e))
+                    continue;
+                  time_stamp = e.time_stamp;
+                  response = e.response;
+                  mode_idx = e.mode;
+                  lun = e.lun;
+                  io_offset = e.offset;
+                  size = e.size;
+                  if (!keepEntry (&ctx->opts, mode_idx, time_stamp, lun, size))
+                    continue;
+
+                  /* Feed the aggregates from the same parse. */
+                  if (agg_mask)
+                    accumulate (&local_agg[mode_idx], lun, time_stamp,
+                                sizeSlot (ctx->slot_size[mode_idx], ctx->cnt[mode_idx], size),
+                                response < 0 ? -1 : (long int) (response * 1e9 + 0.5));
+
+                  /* Fill in an empty slot in corresponding node array. */
+                  slot_idx[mode_idx]++;
+                  ctx->node_arr[mode_idx][slot_idx[mode_idx]].size = size;
+                  ctx->node_arr[mode_idx][slot_idx[mode_idx]].time_stamp = time_stamp;
+                  ctx->node_arr[mode_idx][slot_idx[mode_idx]].src_file_idx = i;
+                  ctx->node_arr[mode_idx][slot_idx[mode_idx]].offset = offset;
+                  ctx->node_arr[mode_idx][slot_idx[mode_idx]].write_offset
+                    = len + (line[len - 1] != '\n');   // Last line may lack the newline.
+                  if (ctx->loc_arr[mode_idx] != NULL)
+                    {
+                      ctx->loc_arr[mode_idx][slot_idx[mode_idx]].offset = io_offset;
+                      ctx->loc_arr[mode_idx][slot_idx[mode_idx]].lun = lun;
+                    }
+                }
+              bytes += offset;
+              free (line);
+              fclose (src_file);
+            }
+
+          /* Merge thread-local accumulators. */
+          if (agg_mask)
+            for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+              {
+                #pragma omp critical
+                mergeAggregate (&ctx->agg_arr[mode_idx], &local_agg[mode_idx]);
+                freeAggregate (&local_agg[mode_idx]);
+              }
+        }
+      tuneEnd (tp, bytes);
+    }
+  free (slot_idx_arr[R_IDX]);
+  free (slot_idx_arr[W_IDX]);
+
+  ctx->stage = STAGE_READ;
+  return 0;
+}
+
+/* Entries sorting stage. */
+int
+tsSortEntries (ts_ctx *ctx)
+{
+  tune_phase *tp;
+  unsigned int pair;                // Threads for the two IO types.
+
+  if (ctx->stage >= STAGE_SORTED)
+    return 0;
+  if (ctx->stage < STAGE_READ && tsAbstractRead (ctx) != 0)
+    return -1;
+  tp = startPhase (ctx, TS_PHASE_SORT, 0);
+  tuneBegin (tp, 1, 1);             // Sorting is not cut into rounds.
+  pair = tp->degree > 1 ? 2 : 1;
+  if (!ctx->opts.views && ctx->opts.reuse_rate <= 0)
+    tp->degree = pair;              // Only the two sorts run, so report what they use.
+
+  /* Extra views permute the records while they are still in ingest order. */
+  if (ctx->opts.views)
+    buildViews (ctx);
+  if (ctx->opts.reuse_rate > 0)
+    analyzeReuse (ctx);
+
+  /* For top-K queries, select the K wanted entries first, so only they get sorted. */
+  if (ctx->opts.top_k != 0)
+    #pragma omp parallel for num_threads(pair)
+    for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+      {
+        node *arr = ctx->node_arr[mode_idx];
+        long unsigned int num = ctx->num[mode_idx];
+        long unsigned int k = ctx->opts.top_k > 0 ? ctx->opts.top_k : -ctx->opts.top_k;
+
+        if (k >= num)
+          continue;
+        if (ctx->opts.top_k > 0)          // K smallest end up in [1, K].
+          select_fns[ctx->sorter] (arr, 1, num, k, ctx->opts.sort_key);
+        else                              // K largest end up in [num - K + 1, num].
+          {
+            select_fns[ctx->sorter] (arr, 1, num, num - k, ctx->opts.sort_key);
+            memmove (&arr[1], &arr[num - k + 1], sizeof (node) * k);
+          }
+        ctx->num[mode_idx] = k;
+      }
+
+  /* For two node arrays, use heap-sort in ascending order of the key, side by side. */
+  #pragma omp parallel for num_threads(pair)
+  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+    {
+      node *arr = ctx->node_arr[mode_idx];
+
+      /* Setup dummy head. */
+      arr[0].size = 0;
+      arr[0].time_stamp = 0;
+      arr[0].src_file_idx = 0;
+      arr[0].offset = 0;
+      arr[0].write_offset = ctx->header_len;
+
+      sort_fns[ctx->sorter] (arr, ctx->num[mode_idx], ctx->opts.sort_key);
+    }
+
+  /* Calculate size counts data in sorted order. */
+  #pragma omp parallel for num_threads(pair)
+  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+    {
+      cnt_struct *size_cnt = ctx->size_cnt_arr[mode_idx];
+
+      for (long unsigned int i = 1; i <= ctx->num[mode_idx]; i++)
+        for (unsigned int j = 0; j < ctx->cnt[mode_idx]; j++)
+          {
+            if (size_cnt[j].size == ctx->node_arr[mode_idx][i].size)   // Already met.
+              {
+                size_cnt[j].cnt++;
+                break;
+              }
+            else if (size_cnt[j].size == 0)                             // First found.
+              {
+                size_cnt[j].size = ctx->node_arr[mode_idx][i].size;
+                size_cnt[j].cnt = 1;
+                break;
+              }
+          }
+
+      /* Selection may have dropped some scanned sizes. */
+      while (ctx->cnt[mode_idx] > 0 && size_cnt[ctx->cnt[mode_idx] - 1].size == 0)
+        ctx->cnt[mode_idx]--;
+    }
+
+  tuneEnd (tp, sizeof (node) * (ctx->num[R_IDX] + ctx->num[W_IDX]));
+  ctx->stage = STAGE_SORTED;
+  return 0;
+}
+
+/* Run every stage not run yet. */
+int
+tsSort (ts_ctx *ctx)
+{
+  return tsSortEntries (ctx);
+}
+
+/* Number of sorted entries of an IO type. */
+long unsigned int
+tsEntries (const ts_ctx *ctx, int mode)
+{
+  return ctx->num[mode];
+}
+
+/* Number of lines skipped for their length. */
+long unsigned int
+tsLongLines (const ts_ctx *ctx)
+{
+  return ctx->long_num;
+}
+
+/* Number of distinct sizes of an IO type. */
+unsigned int
+tsSizes (const ts_ctx *ctx, int mode)
+{
+  return ctx->cnt[mode];
+}
+
+/* Start pulling sorted records. */
+void
+tsIterBegin (ts_ctx *ctx, int mode, ts_iter *it)
+{
+  tsSort (ctx);
+  placeEntries (ctx);
+  it->ctx = ctx;
+  it->mode = mode;
+  it->next = 1;
+  it->pool = NULL;
+}
+
+/* Pull the next sorted record. */
+int
+tsIterNext (ts_iter *it, ts_record *rec)
+{
+  ts_ctx *ctx = it->ctx;
+  node *arr = ctx->node_arr[it->mode];
+  const node *nd;
+  const ts_source *src;
+  long unsigned int len;
+
+  if (it->next > ctx->num[it->mode])
+    {
+      tsIterEnd (it);
+      return 0;
+    }
+  nd = &arr[it->next];
+  src = &ctx->srcs[nd->src_file_idx];
+  len = nd->write_offset - arr[it->next - 1].write_offset;
+  it->next++;
+
+  rec->time_stamp = nd->time_stamp;
+  rec->size = nd->size;
+  rec->source = nd->src_file_idx;
+  rec->len = len;
+
+  /* In-memory lines are handed out in place unless the newline is missing. */
+  if (src->name == NULL && nd->offset + len <= src->len)
+    rec->line = src->data + nd->offset;
+  else
+    {
+      if (src->name == NULL)
+        memcpy (it->line, src->data + nd->offset, len - 1);
+      else
+        {
+          fd_pool *pool;
+          ssize_t done;
+
+          /* File sources stay open through a descriptor pool until the end. */
+          if (it->pool == NULL)
+            it->pool = newSourcePool (ctx);
+          pool = it->pool;
+          done = pread (acquireFd (pool, nd->src_file_idx), it->line, len, nd->offset);
+          releaseFd (pool, nd->src_file_idx);
+          if (done < (ssize_t) len - 1)   // Last line of a source may lack the newline.
+            {
+              tsIterEnd (it);
+              return -1;
+            }
+        }
+      it->line[len - 1] = '\n';     // Last line of a source may lack it.
+      rec->line = it->line;
+    }
+
+  return 1;
+}
+
+/* Stop pulling records. */
+void
+tsIterEnd (ts_iter *it)
+{
+  fd_pool *pool = it->pool;
+
+  if (pool == NULL)
+    return;
+  free (pool->names);               // The names themselves stay owned by the sources.
+  freeFdPool (pool);
+  it->pool = NULL;
+}
+
+/* Write the result of an IO type to a sink in order. */
+int
+tsWriteSink (ts_ctx *ctx, int mode, ts_sink sink, void *arg)
+{
+  char *buf = malloc (GATHER_BUF_SIZE), row[TS_LINE_MAX];
+  long unsigned int len = ctx->header_len;
+  ts_iter it;
+  ts_record rec;
+  int ret = 0, more;
+
+  /* Batch lines into large sink calls. */
+  memcpy (buf, ctx->header, ctx->header_len);
+  tsIterBegin (ctx, mode, &it);
+  while (ret == 0 && (more = tsIterNext (&it, &rec)) != 0)
+    {
+      if (more < 0)
+        {
+          ret = -1;
+          break;
+        }
+      if (len + rec.len > GATHER_BUF_SIZE)
+        {
+          ret = sink (arg, buf, len);
+          len = 0;
+        }
+      memcpy (buf + len, rec.line, rec.len);
+      len += rec.len;
+    }
+
+  tsIterEnd (&it);
+
+  /* Size counts data. */
+  if (ret == 0)
+    {
+      if (len + 12 > GATHER_BUF_SIZE)
+        {
+          ret = sink (arg, buf, len);
+          len = 0;
+        }
+      memcpy (buf + len, "\nSIZE,COUNT\n", 12);
+      len += 12;
+      for (unsigned int j = 0; j < ctx->cnt[mode] && ret == 0; j++)
+        {
+          if (ctx->size_cnt_arr[mode][j].size == 0)
+            break;
+          if (len + TS_LINE_MAX > GATHER_BUF_SIZE)
+            {
+              ret = sink (arg, buf, len);
+              len = 0;
+            }
+          len += snprintf (row, TS_LINE_MAX, "%u,%lu\n", ctx->size_cnt_arr[mode][j].size,
+                           ctx->size_cnt_arr[mode][j].cnt);
+          memcpy (buf + len - strlen (row), row, strlen (row));
+        }
+    }
+  if (ret == 0 && len > 0)
+    ret = sink (arg, buf, len);
+
+  free (buf);
+  return ret;
+}
+
+/* Stream the result of an IO type to a descriptor in order. */
+int
+tsStreamResult (ts_ctx *ctx, int mode, int fd)
+{
+  node *arr;
+  fd_pool *src_pool;
+  long unsigned int num, *bound, chunk_num = 0, next_chunk = 0, emitted = 0, window;
+  char **filled;
+  int use_splice, emitting = 0, failed = 0;
+  pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+  struct stat st;
+  tune_phase *tp;
+
+  if (tsSort (ctx) != 0)
+    return -1;
+  placeEntries (ctx);
+  tp = startPhase (ctx, TS_PHASE_WRITE, 0);
+  tuneBegin (tp, 1, 1);             // Chunks are dealt out at once.
+  arr = ctx->node_arr[mode];
+  num = ctx->num[mode];
+
+  /* Cut entries into chunks of at most one gathering buffer each. */
+  bound = malloc (sizeof (long unsigned int) * (num + 2));
+  bound[0] = 1;
+  for (long unsigned int i = 1; i <= num; i++)
+    if (arr[i].write_offset - arr[bound[chunk_num] - 1].write_offset > GATHER_BUF_SIZE)
+      bound[++chunk_num] = i;
+  if (num > 0)
+    bound[++chunk_num] = num + 1;
+  filled = calloc (chunk_num + 1, sizeof (char *));
+  window = STREAM_AHEAD * tp->degree;
+
+  /* Pipes take chunk pages by `vmsplice', anything else gets plain writes. */
+  use_splice = fstat (fd, &st) == 0 && S_ISFIFO (st.st_mode);
+  if (emitChunk (fd, ctx->header, ctx->header_len, &(int) {0}) != 0)
+    failed = 1;
+
+  /* Use OpenMP for paralleled filling: every thread gathers whole chunks into fresh
+     buffers, and whichever thread completes the oldest pending chunk becomes the
+     single emitter, handing chunks off in order while others keep filling. */
+  src_pool = newSourcePool (ctx);
+  #pragma omp parallel num_threads(tp->degree)
+    {
+      while (1)
+        {
+          long unsigned int c = __atomic_fetch_add (&next_chunk, 1, __ATOMIC_RELAXED), len;
+          char *chunk;
+          gather_buf gb;
+
+          if (c >= chunk_num)
+            break;
+
+          /* Bound the memory held by chunks waiting to be emitted. */
+          pthread_mutex_lock (&lock);
+          while (c >= emitted + window)
+            pthread_cond_wait (&cond, &lock);
+          pthread_mutex_unlock (&lock);
+
+          /* Gather the chunk; with no destination it never flushes or copies. A chunk
+             that cannot be mapped still takes its turn, failing the stream there. */
+          len = arr[bound[c + 1] - 1].write_offset - arr[bound[c] - 1].write_offset;
+          chunk = mmap (NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+          if (chunk != MAP_FAILED)
+            {
+              gb = (gather_buf) {chunk, 0, 0, -1, NULL, 0, 0};
+              writeLines (ctx, src_pool, &gb, arr, bound[c], bound[c + 1]);
+            }
+
+          /* Emit every consecutive ready chunk, unless another thread already does. */
+          pthread_mutex_lock (&lock);
+          filled[c] = chunk;
+          if (!emitting)
+            {
+              emitting = 1;
+              while (emitted < chunk_num && filled[emitted] != NULL)
+                {
+                  long unsigned int e = emitted;
+
+                  pthread_mutex_unlock (&lock);
+                  len = arr[bound[e + 1] - 1].write_offset - arr[bound[e] - 1].write_offset;
+                  if (filled[e] == MAP_FAILED)
+                    failed = 1;
+                  else
+                    {
+                      if (emitChunk (fd, filled[e], len, failed ? &(int) {-1} : &use_splice) != 0)
+                        failed = 1;
+
+                      /* Spliced pages stay referenced by the pipe, and are never written again. */
+                      munmap (filled[e], len);
+                    }
+                  pthread_mutex_lock (&lock);
+                  emitted++;
+                  pthread_cond_broadcast (&cond);
+                }
+              emitting = 0;
+            }
+          pthread_mutex_unlock (&lock);
+        }
+    }
+  free (src_pool->names);
+  freeFdPool (src_pool);
+
+  /* Size counts data. */
+  if (!failed)
+    {
+      char *tail = malloc ((long unsigned int) (ctx->cnt[mode] + 1) * TS_LINE_MAX);
+      long unsigned int tail_len = 12;
+
+      memcpy (tail, "\nSIZE,COUNT\n", 12);
+      for (unsigned int j = 0; j < ctx->cnt[mode]; j++)
+        {
+          if (ctx->size_cnt_arr[mode][j].size == 0)
+            break;
+          tail_len += snprintf (tail + tail_len, TS_LINE_MAX, "%u,%lu\n",
+                                ctx->size_cnt_arr[mode][j].size, ctx->size_cnt_arr[mode][j].cnt);
+        }
+      failed = emitChunk (fd, tail, tail_len, &(int) {0}) != 0;
+      free (tail);
+    }
+
+  tuneEnd (tp, num > 0 ? arr[num].write_offset : ctx->header_len);
+  pthread_mutex_destroy (&lock);
+  pthread_cond_destroy (&cond);
+  free (filled);
+  free (bound);
+  return failed ? -1 : 0;
+}
+
+/* Result writing stage. */
+int
+tsWriteResult (ts_ctx *ctx)
+{
+  fd_pool *src_pool;
+  gz_stream *gz_arr[2] = {NULL, NULL};
+  unsigned int gz_num[2] = {0, 0};      // Compressed slices, one per thread and round.
+  int gzip_level = ctx->opts.gzip_level, dst_fd[2] = {-1, -1}, failed = 0;
+  tune_phase *tp;
+
+  if (tsSort (ctx) != 0)
+    return -1;
+  if (ctx->opts.shards > 0 && ctx->opts.sort_key[0] != TS_KEY_SIZE)
+    return -1;                        // Shards split at ascending size boundaries.
+
+  /* Calculate the offset in destination files to write at. */
+  placeEntries (ctx);
+  tp = startPhase (ctx, TS_PHASE_WRITE, 0);
+
+  /* Source files are shared through a bounded descriptor pool, destination
+     files are truncated once before threads write into them; any file that
+     cannot be opened (e.g. no output directory) fails the stage. */
+  src_pool = newSourcePool (ctx);
+  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+    for (int view = 0; view < TS_VIEWS; view++)
+      if (ctx->view_arr[mode_idx][view] != NULL && !failed)
+        failed = writeView (ctx, src_pool, mode_idx, view) != 0;
+  if (!failed)
+    failed = writeReuseFile (ctx) != 0;
+  if (!failed && ctx->opts.shards > 0)
+    {
+      tuneBegin (tp, 1, 1);           // Shard files are dealt out at once.
+      failed = writeShards (ctx, src_pool) != 0;
+      tuneEnd (tp, ctx->node_arr[R_IDX][ctx->num[R_IDX]].write_offset
+                   + ctx->node_arr[W_IDX][ctx->num[W_IDX]].write_offset);
+      free (src_pool->names);
+      freeFdPool (src_pool);
+      return failed ? -1 : 0;
+    }
+  for (int mode_idx = 0; mode_idx < 2 && !failed; mode_idx++)
+    {
+      snprintf (ctx->dst_name[mode_idx], NAME_LENGTH_MAX, "%s/%c.csv%s", ctx->opts.out_dir,
+                mode_idx == R_IDX ? 'R' : 'W', gzip_level ? ".gz" : "");
+      dst_fd[mode_idx] = open (ctx->dst_name[mode_idx], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      failed = dst_fd[mode_idx] < 0;
+    }
+  if (failed)
+    {
+      for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+        if (dst_fd[mode_idx] >= 0)
+          close (dst_fd[mode_idx]);
+      free (src_pool->names);
+      freeFdPool (src_pool);
+      return -1;
+    }
+
+  /* Write each IO type in rounds of entries, the first ones probing parallel degrees;
+     lines land at their own offsets whichever round writes them. */
+  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+    {
+      node *arr = ctx->node_arr[mode_idx];
+      long unsigned int num = ctx->num[mode_idx], next = 1, round, gz_base = 0;
+
+      do
+        {
+          unsigned int gz_first = gz_num[mode_idx];
+
+          round = tuneBegin (tp, num + 1 - next, num);
+          if (gzip_level)
+            {
+              gz_arr[mode_idx] = realloc (gz_arr[mode_idx],
+                                          sizeof (gz_stream) * (gz_first + tp->degree));
+              memset (&gz_arr[mode_idx][gz_first], 0, sizeof (gz_stream) * tp->degree);
+              gz_num[mode_idx] += tp->degree;
+            }
+
+          /* Use OpenMP for paralleled writing. */
+          #pragma omp parallel num_threads(tp->degree) reduction(|:failed)
+            {
+              int thread_id = omp_get_thread_num (), num_threads = omp_get_num_threads ();
+              long unsigned int workload = round / num_threads;
+              long unsigned int start = next + thread_id * workload;
+              long unsigned int end = thread_id == num_threads - 1 ? next + round
+                                                                   : start + workload;
+              gather_buf gb = {malloc (GATHER_BUF_SIZE), 0,
+                               next == 1 && thread_id == 0 ? 0 : arr[start - 1].write_offset,
+                               dst_fd[mode_idx],
+                               gzip_level ? &gz_arr[mode_idx][gz_first + thread_id] : NULL,
+                               gzip_level, 0};
+
+              /* First thread writes the instruction line. */
+              if (next == 1 && thread_id == 0)
+                appendGather (&gb, ctx->header, ctx->header_len);
+
+              /* All threads write their own lines sections concurrently. */
+              writeLines (ctx, src_pool, &gb, arr, start, end);
+
+              /* Last thread writes the size counts data. */
+              if (end == num + 1 && thread_id == num_threads - 1)
+                {
+                  char row[TS_LINE_MAX];
+
+                  appendGather (&gb, "\nSIZE,COUNT\n", 12);
+                  for (unsigned int j = 0; j < ctx->cnt[mode_idx]; j++)
+                    {
+                      if (ctx->size_cnt_arr[mode_idx][j].size == 0)
+                        break;
+                      appendGather (&gb, row, snprintf (row, TS_LINE_MAX, "%u,%lu\n",
+                                                        ctx->size_cnt_arr[mode_idx][j].size,
+                                                        ctx->size_cnt_arr[mode_idx][j].cnt));
+                    }
+                }
+              flushGather (&gb);
+              free (gb.data);
+              failed |= gb.failed;
+
+              /* Compressed slices are laid out in order once all sizes are known. */
+              if (gzip_level)
+                {
+                  long unsigned int gz_off = gz_base;
+
+                  #pragma omp barrier
+                  for (int t = 0; t < thread_id; t++)
+                    gz_off += gz_arr[mode_idx][gz_first + t].len;
+                  if (pwrite (gb.fd, gb.gz->data, gb.gz->len, gz_off) != (ssize_t) gb.gz->len)
+                    failed = 1;
+                }
+            }
+          for (unsigned int t = gz_first; t < gz_num[mode_idx]; t++)
+            gz_base += gz_arr[mode_idx][t].len;
+
+          tuneEnd (tp, arr[next + round - 1].write_offset - arr[next - 1].write_offset);
+          next += round;
+        }
+      while (next <= num);
+      close (dst_fd[mode_idx]);
+    }
+
+  /* Two threads emit the size / time lookup indexes, frame indexes and aggregates. */
+  #pragma omp parallel for num_threads(2) reduction(|:failed)
+  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+    {
+      char side_name[NAME_LENGTH_MAX + 8];
+
+      failed |= writeIndex (ctx, mode_idx) != 0;
+      if (gzip_level)
+        {
+          FILE *frames_file;
+
+          snprintf (side_name, sizeof (side_name), "%s.frames", ctx->dst_name[mode_idx]);
+          if ((frames_file = fopen (side_name, "w")) == NULL)
+            failed = 1;
+          else
+            {
+              writeFrameIndex (frames_file, gz_arr[mode_idx], gz_num[mode_idx]);
+              failed |= closeFile (frames_file) != 0;
+            }
+        }
+      failed |= writeAggregateFile (ctx, mode_idx) != 0;
+    }
+  free (src_pool->names);           // The names themselves stay owned by the sources.
+  freeFdPool (src_pool);
+  if (gzip_level)
+    for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+      {
+        for (unsigned int t = 0; t < gz_num[mode_idx]; t++)
+          freeGzStream (&gz_arr[mode_idx][t]);
+        free (gz_arr[mode_idx]);
+      }
+
+  return failed ? -1 : 0;
+}
+
+/* Print the parallel degree a phase ran at last. */
+void
+tsReportPhase (const ts_ctx *ctx, int phase, FILE *file)
+{
+  tuneReport (&ctx->tune[phase], file);
+}
+
+/* Auxiliary function for registering a source. */
+static int
+addSource (ts_ctx *ctx, char *name, const char *data, long unsigned int len, int owned)
+{
+  ts_source *src;
+
+  if (ctx->stage != STAGE_NONE)     // Sources are fixed once scanning started.
+    {
+      free (name);
+      return -1;
+    }
+  if (ctx->src_num == ctx->src_cap)
+    {
+      ctx->src_cap = ctx->src_cap ? ctx->src_cap * 2 : 64;
+      ctx->srcs = realloc (ctx->srcs, sizeof (ts_source) * ctx->src_cap);
+    }
+  src = &ctx->srcs[ctx->src_num];
+  src->name = name;
+  src->data = data;
+  src->len = len;
+  src->owned = owned;
+
+  return ctx->src_num++;
+}
+
+/* Auxiliary function for opening a source as a stream. */
+static FILE *
+openSource (const ts_source *src)
+{
+  if (src->name != NULL)
+    return fopen (src->name, "r");
+  if (src->len == 0)
+    return NULL;
+  return fmemopen ((char *) src->data, src->len, "r");
+}
+
+/* Auxiliary function for skipping the instruction line, if any: the first line
+   is one when the time stamp column of the layout holds no number there. Returns
+   the offset of the first entry. */
+static long unsigned int
+skipHeader (FILE *src_file, const ts_schema *schema)
+{
+  char *line = NULL, *end;
+  const char *col;
+  size_t line_cap = 0;
+  ssize_t len = getline (&line, &line_cap, src_file);
+  int ts_col = schema->format == TS_FORMAT_ALIBABA ? 4
+               : schema->format == TS_FORMAT_COLUMNS ? schema->ts : 0;
+
+  if (len <= 0)
+    {
+      free (line);
+      return 0;
+    }
+  for (col = line; ts_col > 0 && col != NULL; ts_col--)
+    if ((col = strchr (col, ',')) != NULL)
+      col++;
+  if (col != NULL && (strtod (col, &end), end != col))
+    len = 0;                          // An entry, read again by the caller.
+  free (line);
+  fseek (src_file, len, SEEK_SET);
+
+  return len;
+}
+
+/* Auxiliary function for parsing an entry line; returns 0 for lines to skip.
+   Known formats get their own scan, other layouts are split into columns. */
+static inline int
+parseEntry (const ts_schema *schema, const char *line, ts_entry *e)
+{
+  char type[TS_LINE_MAX];
+  long unsigned int raw;
+
+  switch (schema->format)
+    {
+    case TS_FORMAT_SYSTOR:            // An empty response leaves a comma at 21.
+      e->response = -1;
+      if (strnlen (line, 22) == 22 && line[21] == ',' ? sscanf (line, "%lf,,%1s,%u,%lu,%u", &e->time_stamp, type, &e->lun,
+                                    &e->offset, &e->size) != 5
+                          : sscanf (line, "%lf,%lf,%1s,%u,%lu,%u", &e->time_stamp, &e->response,
+                                    type, &e->lun, &e->offset, &e->size) != 6)
+        return 0;
+      break;
+    case TS_FORMAT_MSR:
+      if (sscanf (line, "%lu,%*[^,],%u,%63[^,],%lu,%u,%lf", &raw, &e->lun, type, &e->offset,
+                  &e->size, &e->response) != 6)
+        return 0;
+      e->time_stamp = (raw - FILETIME_EPOCH) / 1e7;
+      e->response /= 1e7;
+      break;
+    case TS_FORMAT_ALIBABA:
+      if (sscanf (line, "%u,%1s,%lu,%u,%lu", &e->lun, type, &e->offset, &e->size, &raw) != 5)
+        return 0;
+      e->time_stamp = raw / 1e6;
+      e->response = -1;
+      break;
+    default:
+      return parseColumns (schema, line, e);
+    }
+  e->mode = type[0] == 'W' || type[0] == 'w' ? TS_WRITE : TS_READ;
+
+  return 1;
+}
+
+/* Auxiliary function for parsing an entry line of a layout given by columns. */
+static int
+parseColumns (const ts_schema *schema, const char *line, ts_entry *e)
+{
+  const char *col[COLUMNS_MAX];
+  char *end;
+  int col_num = 1;
+
+  col[0] = line;
+  for (const char *c = line; *c != '\0' && col_num < COLUMNS_MAX; c++)
+    if (*c == ',')
+      col[col_num++] = c + 1;
+  if (schema->ts >= col_num || schema->type >= col_num || schema->lun >= col_num
+      || schema->offset >= col_num || schema->size >= col_num || schema->resp >= col_num)
+    return 0;
+
+  e->time_stamp = strtod (col[schema->ts], &end) * schema->ts_unit + schema->ts_epoch;
+  if (end == col[schema->ts])         // A header, or no entry at all.
+    return 0;
+  e->response = schema->resp >= 0 && *col[schema->resp] != ',' && *col[schema->resp] != '\0'
+                ? strtod (col[schema->resp], NULL) * schema->resp_unit : -1;
+  e->mode = *col[schema->type] == 'W' || *col[schema->type] == 'w' ? TS_WRITE : TS_READ;
+  e->lun = strtoul (col[schema->lun], NULL, 10);
+  e->offset = strtoul (col[schema->offset], NULL, 10);
+  e->size = strtoul (col[schema->size], NULL, 10);
+
+  return 1;
+}
+
+/* Auxiliary function for accumulating write offsets once. */
+static void
+placeEntries (ts_ctx *ctx)
+{
+  if (ctx->placed)
+    return;
+  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+    for (long unsigned int i = 1; i <= ctx->num[mode_idx]; i++)
+      ctx->node_arr[mode_idx][i].write_offset += ctx->node_arr[mode_idx][i - 1].write_offset;
+  ctx->placed = 1;
+}
+
+/* Auxiliary function for building the extra views from the records in ingest
+   order: each view sorts a permutation of slots, then keeps just the lines. */
+static void
+buildViews (ts_ctx *ctx)
+{
+  /* One task per IO type and view, all sharing the same record store. */
+  #pragma omp parallel for collapse(2) schedule(dynamic) \
+                           num_threads(ctx->tune[TS_PHASE_SORT].degree)
+  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+    for (int view = 0; view < TS_VIEWS; view++)
+      {
+        const node *arr = ctx->node_arr[mode_idx];
+        long unsigned int num = ctx->num[mode_idx], *perm;
+        view_key key = {arr, ctx->loc_arr[mode_idx]};
+        line_ref *ref;
+
+        if (!(ctx->opts.views & 1 << view))
+          continue;
+        perm = malloc (sizeof (long unsigned int) * (num + 1));
+        for (long unsigned int i = 0; i < num; i++)
+          perm[i] = i + 1;
+        qsort_r (perm, num, sizeof (long unsigned int),
+                 1 << view == TS_VIEW_LUN ? cmpLunView : cmpTimeView, &key);
+
+        ref = malloc (sizeof (line_ref) * (num + 1));
+        for (long unsigned int i = 0; i < num; i++)
+          {
+            ref[i].offset = arr[perm[i]].offset;
+            ref[i].src_file_idx = arr[perm[i]].src_file_idx;
+            ref[i].len = arr[perm[i]].write_offset;     // Still the line length.
+          }
+        free (perm);
+        ctx->view_arr[mode_idx][view] = ref;
+      }
+  ctx->view_num[R_IDX] = ctx->num[R_IDX];
+  ctx->view_num[W_IDX] = ctx->num[W_IDX];
+}
+
+/* Auxiliary function for computing reuse distances and working sets per LUN
+   over the block accesses of both IO types, in time order. */
+static void
+analyzeReuse (ts_ctx *ctx)
+{
+  unsigned int lun_num = ctx->lun_max + 1;
+  long int hour_base = (long int) (ctx->ts_min / 3600);
+  unsigned int hour_num = (long int) (ctx->ts_max / 3600) - hour_base + 1;
+  double rate = ctx->opts.reuse_rate < 1 ? ctx->opts.reuse_rate : 1;
+
+  long unsigned int *first, *fill;
+  access_ref *ref_arr;
+
+  if (ctx->num[R_IDX] + ctx->num[W_IDX] == 0)
+    return;
+  ctx->reuse_arr = calloc (lun_num, sizeof (reuse_stat));
+  ctx->reuse_num = lun_num;
+
+  /* Bucket the records by LUN once: count, prefix-sum, scatter. */
+  first = calloc (lun_num + 1, sizeof (long unsigned int));
+  fill = malloc (sizeof (long unsigned int) * lun_num);
+  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+    for (long unsigned int i = 1; i <= ctx->num[mode_idx]; i++)
+      first[ctx->loc_arr[mode_idx][i].lun + 1]++;
+  for (unsigned int lun = 0; lun < lun_num; lun++)
+    {
+      fill[lun] = first[lun];
+      first[lun + 1] += first[lun];
+    }
+  ref_arr = malloc (sizeof (access_ref) * (first[lun_num] + 1));
+  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+    for (long unsigned int i = 1; i <= ctx->num[mode_idx]; i++)
+      {
+        access_ref *r = &ref_arr[fill[ctx->loc_arr[mode_idx][i].lun]++];
+
+        r->time_stamp = ctx->node_arr[mode_idx][i].time_stamp;
+        r->slot = (long unsigned int) mode_idx << 63 | i;
+      }
+  free (fill);
+
+  /* LUNs share no blocks: each task orders and replays its own bucket. */
+  #pragma omp parallel for schedule(dynamic) num_threads(ctx->tune[TS_PHASE_SORT].degree)
+  for (unsigned int lun = 0; lun < lun_num; lun++)
+    {
+      reuse_stat *st = &ctx->reuse_arr[lun];
+      access_ref *ref = &ref_arr[first[lun]];
+      long unsigned int ref_num = first[lun + 1] - first[lun], block_num = 0;
+
+      for (long unsigned int k = 0; k < ref_num; k++)
+        {
+          int mode_idx = ref[k].slot >> 63;
+          long unsigned int i = ref[k].slot & ~(1UL << 63);
+          const io_loc *loc = &ctx->loc_arr[mode_idx][i];
+          unsigned int size = ctx->node_arr[mode_idx][i].size;
+
+          for (long unsigned int b = loc->offset / REUSE_BLOCK;
+               b <= (loc->offset + (size ? size - 1 : 0)) / REUSE_BLOCK; b++)
+            block_num += reuseSampled (lun, b, rate);
+        }
+      qsort (ref, ref_num, sizeof (access_ref), cmpAccess);
+
+      /* Every block an entry covers is one access. */
+      initReuse (st, lun, rate, block_num, hour_base, hour_num);
+      for (long unsigned int k = 0; k < ref_num; k++)
+        {
+          int mode_idx = ref[k].slot >> 63;
+          long unsigned int i = ref[k].slot & ~(1UL << 63);
+          const io_loc *loc = &ctx->loc_arr[mode_idx][i];
+          unsigned int size = ctx->node_arr[mode_idx][i].size;
+
+          for (long unsigned int b = loc->offset / REUSE_BLOCK;
+               b <= (loc->offset + (size ? size - 1 : 0)) / REUSE_BLOCK; b++)
+            if (reuseSampled (lun, b, rate))
+              reuseAccess (st, b, ref[k].time_stamp);
+        }
+      finishReuse (st);
+    }
+  free (ref_arr);
+  free (first);
+}
+
+/* Auxiliary function for adding a size to a set, doubling it past half full. */
+static void
+addSize (size_set *set, unsigned int size)
+{
+  long unsigned int i;
+
+  if (set->slots == NULL || 2 * (set->num + 1) > set->mask + 1)
+    {
+      long unsigned int cap = set->slots ? 2 * (set->mask + 1) : 64;
+      size_set grown = {calloc (cap, sizeof (long unsigned int)), 0, cap - 1};
+
+      mergeSizes (&grown, set);
+      free (set->slots);
+      *set = grown;
+    }
+  for (i = size * 0x9e3779b1U & set->mask; set->slots[i] != 0; i = (i + 1) & set->mask)
+    if (set->slots[i] == size + 1UL)
+      return;
+  set->slots[i] = size + 1UL;
+  set->num++;
+}
+
+/* Auxiliary function for adding every size of SRC to DST. */
+static void
+mergeSizes (size_set *dst, const size_set *src)
+{
+  if (src->slots == NULL)
+    return;
+  for (long unsigned int i = 0; i <= src->mask; i++)
+    if (src->slots[i] != 0)
+      addSize (dst, src->slots[i] - 1);
+}
+
+/* Auxiliary function for listing the sizes of a set in ascending order. */
+static unsigned int *
+sortSizes (const size_set *set)
+{
+  unsigned int *arr = malloc (sizeof (unsigned int) * (set->num + 1)), num = 0;
+
+  if (set->slots != NULL)
+    for (long unsigned int i = 0; i <= set->mask; i++)
+      if (set->slots[i] != 0)
+        arr[num++] = set->slots[i] - 1;
+  qsort (arr, num, sizeof (unsigned int), cmpSize);
+  return arr;
+}
+
+/* Auxiliary function for ordering sizes. */
+static int
+cmpSize (const void *a, const void *b)
+{
+  unsigned int x = *(const unsigned int *) a, y = *(const unsigned int *) b;
+
+  return (x > y) - (x < y);
+}
+
+/* Auxiliary function for the ascending slot of a known size. */
+static inline unsigned int
+sizeSlot (const unsigned int *slot_size, unsigned int cnt, unsigned int size)
+{
+  unsigned int lo = 0, hi = cnt - 1;
+
+  while (lo < hi)
+    {
+      unsigned int mid = lo + (hi - lo) / 2;
+
+      if (slot_size[mid] < size)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+/* Auxiliary function for ordering records by time stamp, ties by IO type and slot. */
+static int
+cmpAccess (const void *a, const void *b)
+{
+  const access_ref *x = a, *y = b;
+
+  if (x->time_stamp != y->time_stamp)
+    return x->time_stamp < y->time_stamp ? -1 : 1;
+  return (x->slot > y->slot) - (x->slot < y->slot);
+}
+
+/* Auxiliary function for ordering slots by (LUN, IO offset, time stamp), ties
+   in ingest order. */
+static int
+cmpLunView (const void *a, const void *b, void *arg)
+{
+  const view_key *key = arg;
+  long unsigned int x = *(const long unsigned int *) a, y = *(const long unsigned int *) b;
+  const io_loc *p = &key->loc[x], *q = &key->loc[y];
+
+  if (p->lun != q->lun)
+    return p->lun < q->lun ? -1 : 1;
+  if (p->offset != q->offset)
+    return p->offset < q->offset ? -1 : 1;
+  if (key->arr[x].time_stamp != key->arr[y].time_stamp)
+    return key->arr[x].time_stamp < key->arr[y].time_stamp ? -1 : 1;
+  return (x > y) - (x < y);
+}
+
+/* Auxiliary function for ordering slots by time stamp, ties in ingest order. */
+static int
+cmpTimeView (const void *a, const void *b, void *arg)
+{
+  const view_key *key = arg;
+  long unsigned int x = *(const long unsigned int *) a, y = *(const long unsigned int *) b;
+
+  if (key->arr[x].time_stamp != key->arr[y].time_stamp)
+    return key->arr[x].time_stamp < key->arr[y].time_stamp ? -1 : 1;
+  return (x > y) - (x < y);
+}
+
+/* Auxiliary function for pooling descriptors of file sources. */
+static fd_pool *
+newSourcePool (ts_ctx *ctx)
+{
+  char **names = malloc (sizeof (char *) * (ctx->src_num + 1));
+
+  for (unsigned int i = 0; i < ctx->src_num; i++)
+    names[i] = ctx->srcs[i].name;
+  return newFdPool (names, ctx->src_num, fdPoolLimit ());
+}
+
+/* Auxiliary function for handing a chunk to the stream. USE_SPLICE is 1 to try
+   `vmsplice' (cleared once unsupported), 0 for `write', -1 to drop it. */
+static int
+emitChunk (int fd, const char *chunk, long unsigned int len, int *use_splice)
+{
+  long unsigned int done = 0;
+  int ret = *use_splice < 0 ? -1 : 0;
+
+  while (ret == 0 && done < len)
+    {
+      ssize_t n;
+
+      if (*use_splice == 1)
+        {
+          struct iovec iov = {(char *) chunk + done, len - done};
+
+          n = vmsplice (fd, &iov, 1, 0);
+          if (n < 0 && (errno == EINVAL || errno == ENOSYS))
+            {
+              *use_splice = 0;
+              continue;
+            }
+        }
+      else
+        n = write (fd, chunk + done, len - done);
+      if (n < 0 && errno != EINTR)
+        ret = -1;
+      else if (n > 0)
+        done += n;
+    }
+
+  return ret;
+}
+
+/* Auxiliary function for writing each IO type as shards split at size boundaries,
+   plus a manifest of them; returns -1 if any file cannot be written. */
+static int
+writeShards (ts_ctx *ctx, fd_pool *src_pool)
+{
+  unsigned int shard_num = 0, shards = ctx->opts.shards;
+  int failed = 0;
+  shard *shard_arr = malloc (sizeof (shard) * 2 * shards);
+  const char *suffix = ctx->opts.gzip_level ? ".gz" : "";
+
+  /* Cut each node array into shards of balanced bytes; a size run is never split,
+     so a shard closes at the first run boundary past its share of the bytes left. */
+  for (int mode_idx = 0; mode_idx < 2; mode_idx++)
+    {
+      node *arr = ctx->node_arr[mode_idx];
+      long unsigned int num = ctx->num[mode_idx], start = 1, end;
+
+      for (unsigned int k = 0; start <= num; k++, start = end)
+        {
+          long unsigned int left = arr[num].write_offset - arr[start - 1].write_offset;
+          long unsigned int target = arr[start - 1].write_offset + left / (shards - k);
+
+          end = start;
+          do
+            for (end++; end <= num && arr[end].size == arr[end - 1].size; end++)
+              ;
+          while (end <= num && arr[end - 1].write_offset < target);
+          shard_arr[shard_num++] = (shard) {mode_idx, k, start, end, 0};
+        }
+    }
+
+  /* Use OpenMP for paralleled writing, each thread owns whole shard files. */
+  #pragma omp parallel num_threads(ctx->tune[TS_PHASE_WRITE].degree) reduction(|:failed)
+    {
+      char *buf = malloc (GATHER_BUF_SIZE), shard_name[NAME_LENGTH_MAX];
+
+      #pragma omp for schedule(dynamic)
+      for (unsigned int i = 0; i < shard_num; i++)
+        {
+          shard *sh = &shard_arr[i];
+          gz_stream gz = {0};
+          gather_buf gb = {buf, 0, 0, -1, ctx->opts.gzip_level ? &gz : NULL,
+                           ctx->opts.gzip_level, 0};
+
+          snprintf (shard_name, NAME_LENGTH_MAX, "%s/%c.%03u.csv%s", ctx->opts.out_dir,
+                    sh->mode_idx == R_IDX ? 'R' : 'W', sh->idx, suffix);
+          gb.fd = open (shard_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+          if (gb.fd < 0)
+            {
+              failed = 1;
+              continue;
+            }
+          appendGather (&gb, ctx->header, ctx->header_len);
+          writeLines (ctx, src_pool, &gb, ctx->node_arr[sh->mode_idx], sh->start, sh->end);
+          flushGather (&gb);
+          if (gb.gz != NULL)
+            {
+              if (pwrite (gb.fd, gz.data, gz.len, 0) != (ssize_t) gz.len)
+                gb.failed = 1;
+              sh->bytes = gz.len;
+              freeGzStream (&gz);
+            }
+          else
+            sh->bytes = gb.off;
+          failed |= gb.failed;
+          close (gb.fd);
+        }
+      free (buf);
+    }
+
+  /* Manifests list every shard with its size range, line count and byte count. */
+  for (int mode_idx = 0; mode_idx < 2 && !failed; mode_idx++)
+    {
+      char list_name[NAME_LENGTH_MAX];
+      FILE *list_file;
+
+      snprintf (list_name, NAME_LENGTH_MAX, "%s/%c.manifest.csv", ctx->opts.out_dir,
+                mode_idx == R_IDX ? 'R' : 'W');
+      if ((list_file = fopen (list_name, "w")) == NULL)
+        {
+          failed = 1;
+          break;
+        }
+      fprintf (list_file, "SHARD,SIZE_MIN,SIZE_MAX,LINES,BYTES\n");
+      for (unsigned int i = 0; i < shard_num; i++)
+        if (shard_arr[i].mode_idx == mode_idx)
+          {
+            node *arr = ctx->node_arr[mode_idx];
+
+            fprintf (list_file, "%c.%03u.csv%s,%u,%u,%lu,%lu\n", mode_idx == R_IDX ? 'R' : 'W',
+                     shard_arr[i].idx, suffix, arr[shard_arr[i].start].size,
+                     arr[shard_arr[i].end - 1].size, shard_arr[i].end - shard_arr[i].start,
+                     shard_arr[i].bytes);
+          }
+      failed |= closeFile (list_file) != 0;
+      failed |= writeAggregateFile (ctx, mode_idx) != 0;
+    }
+
+  free (shard_arr);
+  return failed ? -1 : 0;
+}
+
+/* Auxiliary function for writing the sparse index of a result file; returns -1 if
+   it cannot be written. */
+static int
+writeIndex (ts_ctx *ctx, int mode_idx)
+{
+  char idx_name[NAME_LENGTH_MAX + 8];
+  FILE *idx_file;
+  node *arr = ctx->node_arr[mode_idx];
+  long unsigned int num = ctx->num[mode_idx], end;
+
+  snprintf (idx_name, sizeof (idx_name), "%s.idx", ctx->dst_name[mode_idx]);
+
+  /* Lookups rely on the default order, and read time stamps from the first
+     column, which only SYSTOR lines lead with; drop a stale index otherwise. */
+  if (ctx->sorter != SORT_SIZE_TIME || ctx->opts.schema.format != TS_FORMAT_SYSTOR)
+    {
+      remove (idx_name);
+      return 0;
+    }
+  if ((idx_file = fopen (idx_name, "w")) == NULL)
+    return -1;
+  fprintf (idx_file, "INDEX,%lu,%d\n", num, INDEX_STRIDE);
+
+  /* Entries are sorted by size, so each size occupies one contiguous run, whose
+     byte range follows from the accumulated write offsets. */
+  for (long unsigned int start = 1; start <= num; start = end)
+    {
+      for (end = start + 1; end <= num && arr[end].size == arr[start].size; end++)
+        ;
+      fprintf (idx_file, "S,%u,%lu,%lu,%lu,%lu\n", arr[start].size, start, end - start,
+                                                 arr[start - 1].write_offset,
+                                                 arr[end - 1].write_offset);
+
+      /* Sparse time checkpoints inside the run. */
+      for (long unsigned int i = start; i < end; i += INDEX_STRIDE)
+        fprintf (idx_file, "T,%.17g,%lu,%lu\n", arr[i].time_stamp, i, arr[i - 1].write_offset);
+    }
+
+  return closeFile (idx_file);
+}
+
+/* Auxiliary function for writing the aggregates of an IO type, if selected; returns
+   -1 if they cannot be written. */
+static int
+writeAggregateFile (ts_ctx *ctx, int mode_idx)
+{
+  char agg_name[NAME_LENGTH_MAX];
+  FILE *agg_file;
+
+  if (!ctx->opts.agg_mask)
+    return 0;
+  snprintf (agg_name, NAME_LENGTH_MAX, "%s/%c.agg.csv", ctx->opts.out_dir,
+            mode_idx == R_IDX ? 'R' : 'W');
+  if ((agg_file = fopen (agg_name, "w")) == NULL)
+    return -1;
+  writeAggregate (&ctx->agg_arr[mode_idx], agg_file);
+  return closeFile (agg_file);
+}
+
+/* Auxiliary function for writing an extra view as `<out_dir>/R.<view>.csv' (or W),
+   the instruction line then every line in view order, without size counts; returns
+   -1 if it cannot be written. */
+static int
+writeView (ts_ctx *ctx, fd_pool *src_pool, int mode_idx, int view)
+{
+  const line_ref *ref = ctx->view_arr[mode_idx][view];
+  long unsigned int num = ctx->view_num[mode_idx];
+  unsigned int threads = ctx->tune[TS_PHASE_WRITE].degree;
+  long unsigned int *part = calloc (threads + 1, sizeof (long unsigned int));
+  char view_name[NAME_LENGTH_MAX + 8];
+  int fd, failed = 0;
+
+  snprintf (view_name, sizeof (view_name), "%s/%c.%s.csv", ctx->opts.out_dir,
+            mode_idx == R_IDX ? 'R' : 'W', view_names[view]);
+  fd = open (view_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    {
+      free (part);
+      return -1;
+    }
+
+  /* Threads size their slices, then write them at the prefix sums concurrently. */
+  #pragma omp parallel num_threads(threads) reduction(|:failed)
+    {
+      int thread_id = omp_get_thread_num (), num_threads = omp_get_num_threads ();
+      long unsigned int workload = num / num_threads;
+      long unsigned int start = thread_id * workload;
+      long unsigned int end = thread_id == num_threads - 1 ? num : start + workload;
+      gather_buf gb = {malloc (GATHER_BUF_SIZE), 0, 0, fd, NULL, 0, 0};
+
+      for (long unsigned int i = start; i < end; i++)
+        part[thread_id + 1] += ref[i].len;
+      #pragma omp barrier
+      #pragma omp single
+      for (int t = 1; t <= num_threads; t++)
+        part[t] += part[t - 1];
+
+      if (thread_id == 0)
+        appendGather (&gb, ctx->header, ctx->header_len);
+      else
+        gb.off = ctx->header_len + part[thread_id];
+
+      /* Lines adjacent in the view and in a source file go out as one run. */
+      for (long unsigned int i = start, j; i < end; i = j)
+        {
+          long unsigned int run_len = ref[i].len;
+
+          for (j = i + 1; j < end && ref[j].src_file_idx == ref[i].src_file_idx
+                          && ref[j].offset == ref[i].offset + run_len; j++)
+            run_len += ref[j].len;
+          writeRun (ctx, src_pool, &gb, ref[i].src_file_idx, ref[i].offset, run_len);
+        }
+      flushGather (&gb);
+      free (gb.data);
+      failed |= gb.failed;
+    }
+
+  close (fd);
+  free (part);
+  return failed ? -1 : 0;
+}
+
+/* Auxiliary function for writing the reuse statistics, if computed; returns -1 if
+   they cannot be written. */
+static int
+writeReuseFile (ts_ctx *ctx)
+{
+  char reuse_name[NAME_LENGTH_MAX];
+  FILE *reuse_file;
+
+  if (ctx->reuse_arr == NULL)
+    return 0;
+  snprintf (reuse_name, NAME_LENGTH_MAX, "%s/reuse.csv", ctx->opts.out_dir);
+  if ((reuse_file = fopen (reuse_name, "w")) == NULL)
+    return -1;
+  writeReuse (ctx->reuse_arr, ctx->reuse_num, reuse_file);
+  return closeFile (reuse_file);
+}
+
+/* Auxiliary function for closing a side file written through stdio; returns -1 if
+   any of its writes failed. */
+static int
+closeFile (FILE *file)
+{
+  int failed = ferror (file);
+
+  return fclose (file) != 0 || failed ? -1 : 0;
+}
+
+/* Auxiliary function for writing sorted entries [START, END) through a gathering
+   buffer, one contiguous source run at a time. */
+static void
+writeLines (ts_ctx *ctx, fd_pool *src_pool, gather_buf *gb, node *arr, long unsigned int start,
+            long unsigned int end)
+{
+  for (long unsigned int i = start, j; i < end; i = j)
+    {
+      long unsigned int run_len = arr[i].write_offset - arr[i - 1].write_offset;
+
+      /* Extend the run while the next line follows this one in the same source file. */
+      for (j = i + 1; j < end && arr[j].src_file_idx == arr[i].src_file_idx
+                      && arr[j].offset == arr[i].offset + run_len; j++)
+        run_len += arr[j].write_offset - arr[j - 1].write_offset;
+
+      writeRun (ctx, src_pool, gb, arr[i].src_file_idx, arr[i].offset, run_len);
+    }
+}
+
+/* Auxiliary function for writing one contiguous source run through a gathering buffer. */
+static void
+writeRun (ts_ctx *ctx, fd_pool *src_pool, gather_buf *gb, unsigned int src_idx,
+          long unsigned int src_off, long unsigned int len)
+{
+  const ts_source *src = &ctx->srcs[src_idx];
+  int src_fd = -1;
+
+  /* Long file runs move kernel-side unless compressing, others are gathered. */
+  if (src->name != NULL)
+    src_fd = acquireFd (src_pool, src_idx);
+  if (src_fd >= 0 && gb->fd >= 0 && gb->gz == NULL && len >= COPY_RUN_MIN)
+    {
+      flushGather (gb);
+      if (copyRun (src_fd, src_off, gb->fd, gb->off, len, gb->data) != 0)
+        gb->failed = 1;
+      gb->off += len;
+    }
+  else
+    gatherRun (gb, src, src_fd, src_off, len);
+  if (src->name != NULL)
+    releaseFd (src_pool, src_idx);
+}
+
+/* Auxiliary function for handing gathered bytes to the result file or the compressor. */
+static void
+flushGather (gather_buf *gb)
+{
+  if (gb->len == 0)
+    return;
+  if (gb->gz != NULL)
+    gzFrame (gb->gz, gb->data, gb->len, gb->off, gb->level);
+  else if (pwrite (gb->fd, gb->data, gb->len, gb->off) != (ssize_t) gb->len)
+    gb->failed = 1;
+  gb->off += gb->len;
+  gb->len = 0;
+}
+
+/* Auxiliary function for appending a few generated bytes. */
+static void
+appendGather (gather_buf *gb, const char *bytes, long unsigned int len)
+{
+  if (gb->len + len > GATHER_BUF_SIZE)
+    flushGather (gb);
+  memcpy (gb->data + gb->len, bytes, len);
+  gb->len += len;
+}
+
+/* Auxiliary function for reading a contiguous source run into the buffer. */
+static void
+gatherRun (gather_buf *gb, const ts_source *src, int src_fd, off_t src_off,
+           long unsigned int len)
+{
+  while (len > 0)
+    {
+      long unsigned int piece;
+
+      if (gb->len == GATHER_BUF_SIZE)
+        flushGather (gb);
+      piece = len < GATHER_BUF_SIZE - gb->len ? len : GATHER_BUF_SIZE - gb->len;
+      if (src_fd >= 0)
+        pread (src_fd, gb->data + gb->len, piece, src_off);
+      else
+        memcpy (gb->data + gb->len, src->data + src_off,
+                src_off + piece <= src->len ? piece : src->len - src_off);
+      gb->len += piece;
+      src_off += piece;
+      len -= piece;
+    }
+  gb->data[gb->len - 1] = '\n';     // Last line of a source may lack it.
+}
+
+/* Auxiliary function for copying a contiguous source run, kernel-side when possible;
+   returns -1 if the destination falls short. */
+static int
+copyRun (int src_fd, off_t src_off, int dst_fd, off_t dst_off, size_t len, char *bounce)
+{
+  ssize_t done;
+
+  /* Falls back to pread / pwrite through BOUNCE where `copy_file_range' is
+     unsupported (old kernels, cross-filesystem). */
+  while (len > 0 && (done = copy_file_range (src_fd, &src_off, dst_fd, &dst_off, len, 0)) > 0)
+    len -= done;
+  while (len > 0)
+    {
+      done = pread (src_fd, bounce, len < GATHER_BUF_SIZE ? len : GATHER_BUF_SIZE, src_off);
+      if (done <= 0)    // Only the newline after the last line of a source file can be missing.
+        return pwrite (dst_fd, "\n", 1, dst_off) == 1 ? 0 : -1;
+      if (pwrite (dst_fd, bounce, done, dst_off) != done)
+        return -1;
+      src_off += done;
+      dst_off += done;
+      len -= done;
+    }
+
+  return 0;
+}
+
+/* Auxiliary function for checking the pushed down predicates on an entry. */
+static inline int
+keepEntry (const ts_options *opts, int mode_idx, double time_stamp, unsigned int lun,
+           unsigned int size)
+{
+  return (opts->io_types == 0 || opts->io_types & 1 << mode_idx)
+         && (opts->lun_mask == 0 || (lun < 64 && opts->lun_mask & 1UL << lun))
+         && time_stamp >= opts->ts_from && (opts->ts_to == 0 || time_stamp < opts->ts_to)
+         && size >= opts->size_min && (opts->size_max == 0 || size <= opts->size_max);
+}
+
+/* Auxiliary function for swapping. */
+static inline void
+swap (node *a, node *b)
+{
+  node tmp = *a;
+  *a = *b;
+  *b = tmp;
+}
+
+/* Auxiliary function for comparing nodes. */
+static inline int
+larger (node *a, node *b)
+{
+  return (a->size > b->size) || (a->size == b->size && a->time_stamp > b->time_stamp);
+}
+
+/* Auxiliary function for comparing nodes by time stamp first. */
+static inline int
+largerByTime (node *a, node *b)
+{
+  return (a->time_stamp > b->time_stamp) || (a->time_stamp == b->time_stamp && a->size > b->size);
+}
+
+/* Auxiliary function for comparing nodes by any key. */
+static inline int
+largerByKeys (node *a, node *b, const int *keys)
+{
+  for (int i = 0; i < TS_KEYS && keys[i] != 0; i++)
+    {
+      int cmp = keys[i] == TS_KEY_SIZE || keys[i] == -TS_KEY_SIZE
+                ? (a->size > b->size) - (a->size < b->size)
+                : (a->time_stamp > b->time_stamp) - (a->time_stamp < b->time_stamp);
+
+      if (cmp != 0)
+        return keys[i] > 0 ? cmp > 0 : cmp < 0;
+    }
+  return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * Embeddable trace sorting library: ingest, sort, size counting and writing.
+ *
+ */
+
+#ifndef TRACESORT_H
+#define TRACESORT_H
+
+#include <stdio.h>
+
+/* Max bytes of an entry line, newline included; longer lines are skipped and
+ * counted, buffers holding one as a string take one more. */
+#define TS_LINE_MAX 256
+
+/* IO types. */
+#define TS_READ 0             // Read entries (R.csv).
+#define TS_WRITE 1            // Write entries (W.csv).
+
+/* Extra views, each written as <out_dir>/R.<name>.csv and W.<name>.csv. */
+#define TS_VIEW_LUN 1         // By (LUN, offset, time stamp), "lun".
+#define TS_VIEW_TIME 2        // By time stamp, "time".
+#define TS_VIEWS 2            // Number of extra views.
+
+/* Trace formats. */
+#define TS_FORMAT_SYSTOR 0    // Timestamp,Response,IOType,LUN,Offset,Size (SYSTOR '17).
+#define TS_FORMAT_MSR 1       // Timestamp,Hostname,DiskNumber,Type,Offset,Size,ResponseTime
+                              // (MSR Cambridge, Windows file times).
+#define TS_FORMAT_ALIBABA 2   // device_id,opcode,offset,length,timestamp (Alibaba, in us).
+#define TS_FORMAT_COLUMNS 3   // Any layout given by column positions.
+
+/* Sort key fields, negated for descending order. */
+#define TS_KEY_SIZE 1
+#define TS_KEY_TIME 2
+#define TS_KEYS 2             // Max fields of a sort key.
+
+/* Phases whose parallel degree is tuned, "unzip" being run by drivers. */
+#define TS_PHASE_UNZIP 0
+#define TS_PHASE_SCAN 1
+#define TS_PHASE_READ 2
+#define TS_PHASE_SORT 3
+#define TS_PHASE_WRITE 4
+#define TS_PHASES 5
+
+/* Type definitions. */
+typedef struct ts_ctx ts_ctx;     // Type of a sorting context (opaque).
+typedef struct                    // Type of a trace line layout.
+  {
+    int format;                     // TS_FORMAT_*, results keep the SYSTOR header
+                                    // line only for TS_FORMAT_SYSTOR.
+    int ts, resp, type, lun, offset, size;  // Columns from 0 (TS_FORMAT_COLUMNS only),
+                                            // resp -1 when absent.
+    double ts_unit, ts_epoch;       // Seconds = time stamp * ts_unit + ts_epoch.
+    double resp_unit;               // Seconds per response unit.
+  } ts_schema;
+typedef struct                    // Type of context options.
+  {
+    unsigned int threads;           // Parallel degree of every phase, 0 for adaptive.
+    unsigned int phase_threads[TS_PHASES];  // Degree of one phase (TS_PHASE_*) over
+                                            // threads, 0 for that.
+    int agg_mask;                   // Aggregates to compute (aggregate.h), 0 for none.
+    int gzip_level;                 // Seekable gzip results, 0 for plain text.
+    const char *out_dir;            // Directory of result files, NULL for "output".
+    unsigned int size_min;          // Keep only sizes in [size_min, size_max] while
+    unsigned int size_max;          // reading, size_max 0 for no upper bound.
+    long int top_k;                 // Keep only the K smallest (K > 0) or largest (K < 0)
+                                    // entries by the sort key, 0 for all.
+    unsigned int shards;            // Write up to this many shards per IO type, split at
+                                    // size boundaries, instead of R.csv / W.csv; 0 for off.
+    double ts_from, ts_to;          // Keep only time stamps in [ts_from, ts_to), ts_to 0
+                                    // for no upper bound.
+    long unsigned int lun_mask;     // Keep only LUNs whose bit is set, 0 for all.
+    int io_types;                   // Keep only IO types whose bit (1 << TS_READ,
+                                    // 1 << TS_WRITE) is set, 0 for both.
+    int views;                      // Extra orderings to write beside the size one
+                                    // (TS_VIEW_* bits), 0 for none.
+    double reuse_rate;              // Reuse distances and working sets per LUN over
+                                    // this sampled share of blocks (1 for exact) into
+                                    // <out_dir>/reuse.csv, 0 for off.
+    ts_schema schema;               // Layout of source lines, zeroed for SYSTOR.
+    int sort_key[TS_KEYS];          // TS_KEY_* fields to sort by, in order, 0 ended;
+  } ts_options;                     // all 0 for (size, time stamp).
+typedef struct                    // Type of the fields of a parsed entry line.
+  {
+    double time_stamp;              // Seconds.
+    double response;                // Seconds, -1 when absent.
+    long unsigned int offset;       // IO offset.
+    unsigned int lun, size;
+    int mode;                       // TS_READ or TS_WRITE.
+  } ts_entry;
+typedef struct                    // Type of a sorted record handed out by iterators.
+  {
+    double time_stamp;
+    unsigned int size;
+    unsigned int source;            // Index of the source it came from.
+    const char *line;               // Entry line with trailing newline, not terminated.
+    unsigned int len;
+  } ts_record;
+typedef struct                    // Type of a sorted record iterator.
+  {
+    ts_ctx *ctx;
+    int mode;
+    long unsigned int next;
+    char line[TS_LINE_MAX];
+    void *pool;                     // Descriptors of file sources, until tsIterEnd.
+  } ts_iter;
+typedef int (*ts_sink) (void *arg, const char *bytes, long unsigned int len);   // 0 on success.
+
+/* Parse a trace layout: "systor", "msr", "alibaba", or comma separated
+ * <field>=<value> pairs giving the ts, resp, type, lun, offset and size
+ * columns and optionally ts_unit, ts_epoch and resp_unit. Returns 0 or -1. */
+int tsParseSchema (const char *spec, ts_schema *schema);
+
+/* Parse an entry line (terminated, a trailing newline allowed) of a layout
+ * into E, as the pipeline does; returns 1, or 0 for lines holding no entry
+ * (headers, footers, blank or malformed lines). */
+int tsParseLine (const ts_schema *schema, const char *line, ts_entry *e);
+
+/* Parse a sort key: comma separated "size" and "time", each prefixed by '-'
+ * for descending order, into TS_KEYS fields. Returns 0 or -1. */
+int tsParseSortKey (const char *spec, int *keys);
+
+/* Parse parallel degrees: a number for every phase and/or comma separated
+ * <phase>=<number> pairs (unzip, scan, read, sort, write) into OPTS.
+ * Returns 0 or -1. */
+int tsParseThreads (const char *spec, ts_options *opts);
+
+/* Create a context; OPTS may be NULL for defaults. */
+ts_ctx *tsCreate (const ts_options *opts);
+
+/* Reuse a context for another trace with OPTS: drop its sources and results,
+ * keep the node arrays for the next ingest to fill if large enough, and the
+ * parallel degrees learned as the next starting points. */
+void tsReset (ts_ctx *ctx, const ts_options *opts);
+
+/* Release a context and every source it owns. */
+void tsDestroy (ts_ctx *ctx);
+
+/* Add a trace CSV file by path; it is opened on demand, so any number of
+ * files can be added. Returns the source index or -1. */
+int tsAddFile (ts_ctx *ctx, const char *path);
+
+/* Whether a source file may hold entries passing the time and LUN predicates,
+ * judged from a `YYYYMMDDHH-LUN<n>.csv' name (other names always may); lets
+ * callers skip unzipping and adding pruned files. */
+int tsMayMatch (const ts_options *opts, const char *path);
+
+/* Add trace CSV text from memory, without copying; BUF must stay valid
+ * until tsDestroy. Returns the source index or -1. */
+int tsAddBuffer (ts_ctx *ctx, const char *buf, long unsigned int len);
+
+/* Add trace CSV text from a descriptor (regular files are mapped, pipes and
+ * sockets are read to the end); the context does not close FD. Returns the
+ * source index or -1. */
+int tsAddFd (ts_ctx *ctx, int fd);
+
+/* Pipeline stages, in order: count entries and sizes of every source, parse
+ * them into nodes (and aggregates), sort the nodes. Each returns 0 on
+ * success. tsSort runs whichever of them have not run yet. */
+int tsScanStatistics (ts_ctx *ctx);
+int tsAbstractRead (ts_ctx *ctx);
+int tsSortEntries (ts_ctx *ctx);
+int tsSort (ts_ctx *ctx);
+
+/* Number of sorted entries and of distinct sizes of an IO type, and of source
+ * lines skipped for exceeding TS_LINE_MAX (known once scanned). */
+long unsigned int tsEntries (const ts_ctx *ctx, int mode);
+unsigned int tsSizes (const ts_ctx *ctx, int mode);
+long unsigned int tsLongLines (const ts_ctx *ctx);
+
+/* Pull sorted records of an IO type one by one; tsIterNext returns 1 and
+ * fills REC (valid until the next call), 0 at the end or -1 if a source
+ * cannot be read. File sources are kept open in between: tsIterEnd closes
+ * them when stopping early, ending or failing does so by itself. */
+void tsIterBegin (ts_ctx *ctx, int mode, ts_iter *it);
+int tsIterNext (ts_iter *it, ts_record *rec);
+void tsIterEnd (ts_iter *it);
+
+/* Write the result of an IO type (instruction line, sorted entries, SIZE,COUNT
+ * footer) to a sink in order; returns 0 on success. */
+int tsWriteSink (ts_ctx *ctx, int mode, ts_sink sink, void *arg);
+
+/* Stream the result of an IO type (as tsWriteSink) to FD in order: threads
+ * gather ordered chunks in parallel and one emitter at a time hands them
+ * off, by `vmsplice' into pipes and plain writes otherwise; returns 0 on
+ * success. */
+int tsStreamResult (ts_ctx *ctx, int mode, int fd);
+
+/* Write R.csv / W.csv (with lookup indexes, frame indexes and aggregates as
+ * configured) into the output directory in parallel, or with shards set,
+ * R.<n>.csv / W.<n>.csv plus R.manifest.csv / W.manifest.csv; returns 0 on
+ * success, -1 if a result file cannot be written (e.g. the output directory
+ * is missing). */
+int tsWriteResult (ts_ctx *ctx);
+
+/* Print the parallel degree a phase (TS_PHASE_*, not unzip) ran at last and
+ * how it was chosen, e.g. "read 4 (probed 3, 812.4 MB/s)". Phases not fixed
+ * by options start from the processor count (capped by the source count for
+ * scan and read) and probe doubled and halved degrees on their first rounds
+ * by measured throughput; sort is not probed. */
+void tsReportPhase (const ts_ctx *ctx, int phase, FILE *file);
+
+#endif
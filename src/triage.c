@@ -0,0 +1,279 @@
+/*
+ * Approximate statistics of compressed traces in one streaming pass.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <omp.h>
+#include <zlib.h>
+#include "sketch.h"
+#include "tracesort.h"
+
+#pragma GCC diagnostic ignored "-Wunused-result"  // Shutdown unused warnings for `fscanf'.
+
+/* Predefined constants. */
+#define R_IDX 0               // Sketch index of reads.
+#define W_IDX 1               // Sketch index of writes.
+#define TAR_BLOCK 512         // Size of a tar header / data block.
+#define CHUNK_SIZE 262144     // Bytes read or inflated per step.
+
+/* Type definitions. */
+typedef struct                    // Type of a trace member to stream.
+  {
+    const char *path;               // File holding it (a tar archive, or itself).
+    long unsigned int off;
+    long unsigned int len;
+    int gz;                         // Gzip compressed.
+  } member;
+typedef struct                    // Type of a line splitter over a byte stream.
+  {
+    char line[TS_LINE_MAX];
+    int len;
+    int over;                       // Line past TS_LINE_MAX, skipped as the sorter does.
+    sketch *sk;                     // One per IO type.
+  } splitter;
+
+/* Subroutine definitions. */
+static void addMember (const char *path, long unsigned int off, long unsigned int len);
+static void listTar (const char *path);
+static int streamMember (const member *mb, sketch *sk);
+static void splitLines (splitter *sp, const char *bytes, long unsigned int len);
+static void parseLine (splitter *sp);
+static int endsWith (const char *name, const char *suffix);
+
+/* Run options. */
+static ts_schema SCHEMA;                              // Layout of trace lines (`-F').
+
+/* Global variables or containers. */
+static member *member_arr;
+static unsigned int member_num = 0, member_cap = 0;
+
+/* Summarize traces (tar archives, `.csv.gz' or `.csv' files) without sorting. */
+int
+main (int argc, char *argv[])
+{
+  sketch *total = malloc (sizeof (sketch) * 2);
+  long unsigned int failed = 0;
+  glob_t gz_glob;
+  int opt, bad = 0;
+
+  /* Parse options. */
+  while ((opt = getopt (argc, argv, "F:")) != -1)
+    if (opt != 'F' || tsParseSchema (optarg, &SCHEMA) != 0)
+      bad = 1;
+
+  /* List members to stream, by default the archive or compressed files under input/. */
+  if (bad)
+    member_num = 0;                 // Nothing listed, only the usage is printed.
+  else if (optind < argc)
+    for (int i = optind; i < argc; i++)
+      if (endsWith (argv[i], ".tar"))
+        listTar (argv[i]);
+      else
+        addMember (argv[i], 0, 0);
+  else if (access ("input/systor17-01.tar", R_OK) == 0)
+    listTar ("input/systor17-01.tar");
+  else if (glob ("input/*.csv.gz", 0, NULL, &gz_glob) == 0)
+    for (long unsigned int i = 0; i < gz_glob.gl_pathc; i++)
+      addMember (strdup (gz_glob.gl_pathv[i]), 0, 0);
+  if (member_num == 0)
+    {
+      fprintf (stderr, "Usage: %s [-F layout] [<trace.tar | trace.csv.gz | trace.csv> ...]\n",
+               argv[0]);
+      return 1;
+    }
+  initSketch (&total[R_IDX]);
+  initSketch (&total[W_IDX]);
+
+  /* Use OpenMP for paralleled streaming, each thread keeps a fixed-size pair of
+     sketches whatever the trace volume, merged at the end. */
+  #pragma omp parallel reduction(+:failed)
+    {
+      sketch *local = malloc (sizeof (sketch) * 2);
+
+      initSketch (&local[R_IDX]);
+      initSketch (&local[W_IDX]);
+
+      #pragma omp for schedule(dynamic)
+      for (unsigned int i = 0; i < member_num; i++)
+        if (streamMember (&member_arr[i], local) != 0)
+          failed++;
+
+      #pragma omp critical
+        {
+          mergeSketch (&total[R_IDX], &local[R_IDX]);
+          mergeSketch (&total[W_IDX], &local[W_IDX]);
+        }
+      free (local);
+    }
+  if (failed > 0)
+    fprintf (stderr, " %lu of %u members could not be read.\n", failed, member_num);
+
+  writeSketches (&total[R_IDX], &total[W_IDX], stdout);
+  fprintf (stderr, " %u members, %d threads, %lu bytes of sketches each.\n", member_num,
+           omp_get_max_threads (), sizeof (sketch) * 2);
+
+  free (total);
+  free (member_arr);
+  return 0;
+}
+
+/* Auxiliary function for listing a member; LEN 0 means the whole file. */
+static void
+addMember (const char *path, long unsigned int off, long unsigned int len)
+{
+  if (member_num == member_cap)
+    {
+      member_cap = member_cap ? member_cap * 2 : 64;
+      member_arr = realloc (member_arr, sizeof (member) * member_cap);
+    }
+  member_arr[member_num].path = path;
+  member_arr[member_num].off = off;
+  member_arr[member_num].len = len;
+  member_arr[member_num].gz = endsWith (path, ".gz");
+  member_num++;
+}
+
+/* Auxiliary function for listing the trace members of a tar archive, reading
+   headers only. */
+static void
+listTar (const char *path)
+{
+  FILE *tar_file = fopen (path, "r");
+  char header[TAR_BLOCK];
+  long unsigned int off = 0;
+
+  if (tar_file == NULL)
+    return;
+  while (fread (header, 1, TAR_BLOCK, tar_file) == TAR_BLOCK && header[0] != '\0')
+    {
+      char name[TAR_BLOCK], size_field[13] = {0};
+      long unsigned int size;
+
+      /* Name is the ustar prefix plus name field. */
+      memcpy (size_field, header + 124, 12);
+      size = strtoul (size_field, NULL, 8);
+      if (header[345] != '\0')
+        snprintf (name, TAR_BLOCK, "%.155s/%.100s", header + 345, header);
+      else
+        snprintf (name, TAR_BLOCK, "%.100s", header);
+      off += TAR_BLOCK;
+
+      /* Regular trace files only. */
+      if ((header[156] == '0' || header[156] == '\0')
+          && (endsWith (name, ".csv.gz") || endsWith (name, ".csv")) && size > 0)
+        {
+          addMember (path, off, size);
+          member_arr[member_num - 1].gz = endsWith (name, ".gz");
+        }
+      off += (size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+      fseek (tar_file, off, SEEK_SET);
+    }
+  fclose (tar_file);
+}
+
+/* Auxiliary function for streaming one member through the sketches. */
+static int
+streamMember (const member *mb, sketch *sk)
+{
+  int fd = open (mb->path, O_RDONLY);
+  char *in = malloc (CHUNK_SIZE), *out = malloc (CHUNK_SIZE);
+  long unsigned int off = mb->off, left = mb->len;
+  splitter sp = {.len = 0, .over = 0, .sk = sk};
+  z_stream zs = {0};
+  int ret = 0, zret = Z_OK;
+  ssize_t got;
+
+  if (fd < 0 || (mb->gz && inflateInit2 (&zs, 15 + 32) != Z_OK))
+    ret = -1;
+
+  /* Read the member chunk by chunk, inflating every gzip member inside. */
+  while (ret == 0 && (mb->len == 0 || left > 0)
+         && (got = pread (fd, in, mb->len == 0 || left > CHUNK_SIZE ? CHUNK_SIZE : left,
+                          off)) > 0)
+    {
+      off += got;
+      left -= mb->len ? got : 0;
+      if (!mb->gz)
+        {
+          splitLines (&sp, in, got);
+          continue;
+        }
+      zs.next_in = (unsigned char *) in;
+      zs.avail_in = got;
+      do                            // Until input is used up and no output is pending.
+        {
+          zs.next_out = (unsigned char *) out;
+          zs.avail_out = CHUNK_SIZE;
+          zret = inflate (&zs, Z_NO_FLUSH);
+          if (zret != Z_OK && zret != Z_STREAM_END && zret != Z_BUF_ERROR)
+            {
+              ret = -1;
+              break;
+            }
+          splitLines (&sp, out, CHUNK_SIZE - zs.avail_out);
+          if (zret == Z_STREAM_END)
+            inflateReset (&zs);
+          else if (zret == Z_BUF_ERROR)
+            break;
+        }
+      while (zs.avail_in > 0 || zs.avail_out == 0);
+    }
+  if (sp.len > 0 && !sp.over)       // Last line may lack its newline.
+    parseLine (&sp);
+
+  if (mb->gz && fd >= 0)
+    inflateEnd (&zs);
+  if (fd >= 0)
+    close (fd);
+  free (in);
+  free (out);
+  return ret;
+}
+
+/* Auxiliary function for cutting a byte stream into lines. */
+static void
+splitLines (splitter *sp, const char *bytes, long unsigned int len)
+{
+  for (long unsigned int i = 0; i < len; i++)
+    if (bytes[i] == '\n')
+      {
+        if (!sp->over)
+          parseLine (sp);
+        sp->len = sp->over = 0;
+      }
+    else if (sp->len < TS_LINE_MAX - 1)
+      sp->line[sp->len++] = bytes[i];
+    else
+      sp->over = 1;
+}
+
+/* Auxiliary function for accounting one line, through the sorter's own parser of
+   the layout. */
+static void
+parseLine (splitter *sp)
+{
+  ts_entry e;
+
+  sp->line[sp->len] = '\0';
+  if (!tsParseLine (&SCHEMA, sp->line, &e))  // Empty, a header or malformed.
+    return;
+
+  addSketch (&sp->sk[e.mode == TS_WRITE ? W_IDX : R_IDX], e.time_stamp,
+             e.response < 0 ? -1 : (long int) (e.response * 1e9 + 0.5), e.lun, e.offset,
+             e.size);
+}
+
+/* Auxiliary function for checking a file name suffix. */
+static int
+endsWith (const char *name, const char *suffix)
+{
+  size_t name_len = strlen (name), suffix_len = strlen (suffix);
+
+  return name_len >= suffix_len && strcmp (name + name_len - suffix_len, suffix) == 0;
+}
@@ -0,0 +1,127 @@
+/*
+ * Per-phase concurrency controller, hill climbing over doubled / halved degrees.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "tune.h"
+
+static double now (void);
+
+/* Set up a phase. */
+void
+initTune (tune_phase *tp, const char *name, unsigned int start, unsigned int max,
+          unsigned int fixed)
+{
+  unsigned int best = tp->best;     // Learned by an earlier run of the phase.
+
+  memset (tp, 0, sizeof (tune_phase));
+  tp->name = name;
+  tp->max = max > 0 ? max : 1;
+  tp->best = best;
+  tp->fixed = fixed;
+  if (fixed)
+    {
+      tp->degree = fixed;
+      return;
+    }
+  tp->degree = best ? best : start;
+  if (tp->degree > tp->max)
+    tp->degree = tp->max;
+  if (tp->degree < 1)
+    tp->degree = 1;
+  tp->first = tp->degree;
+  tp->step = 1;
+}
+
+/* Begin a round. */
+long unsigned int
+tuneBegin (tune_phase *tp, long unsigned int left, long unsigned int total)
+{
+  long unsigned int slice = total / TUNE_SLICES;
+
+  tp->start = now ();
+  if (tp->step == 0)
+    return left;
+
+  /* Probe only within the first half of the phase, then run the rest at once. */
+  if (slice < tp->degree)
+    slice = tp->degree;
+  if ((total - left + slice) * 2 > total)
+    {
+      if (tp->probes > 0)
+        tp->degree = tp->best;
+      tp->step = 0;
+      return left;
+    }
+  return slice;
+}
+
+/* End a round, adjusting the degree. */
+void
+tuneEnd (tune_phase *tp, double work)
+{
+  double secs = now () - tp->start, rate = work / (secs > 1e-9 ? secs : 1e-9);
+  unsigned int next = 0;
+  int improved;
+
+  tp->work += work;
+  tp->secs += secs;
+  if (tp->step == 0)
+    return;
+
+  tp->probes++;
+  improved = tp->probes == 1 || rate > tp->best_rate * (1 + TUNE_GAIN);
+  if (improved)
+    {
+      tp->best = tp->degree;
+      tp->best_rate = rate;
+    }
+
+  /* Double while it pays off; if it never did, halve instead. */
+  if (tp->step > 0 && improved && tp->degree * 2 <= tp->max)
+    next = tp->degree * 2;
+  else if (tp->step > 0 && tp->best == tp->first)
+    {
+      tp->step = -1;
+      next = tp->first / 2;
+    }
+  else if (tp->step < 0 && improved)
+    next = tp->degree / 2;
+
+  if (next == 0)
+    {
+      tp->degree = tp->best;
+      tp->step = 0;
+    }
+  else
+    tp->degree = next;
+}
+
+/* Print what a phase chose. */
+void
+tuneReport (const tune_phase *tp, FILE *file)
+{
+  fprintf (file, "%s %u (", tp->name, tp->degree);
+  if (tp->fixed)
+    fprintf (file, "fixed");
+  else if (tp->probes > 1)
+    fprintf (file, "probed %u", tp->probes);
+  else
+    fprintf (file, "unprobed");
+  if (tp->work > 0 && tp->secs > 0)
+    fprintf (file, ", %.1f MB/s", tp->work / tp->secs / 1048576);
+  fprintf (file, ")");
+}
+
+/* Auxiliary function for reading a monotonic clock in seconds. */
+static double
+now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
@@ -0,0 +1,51 @@
+/*
+ * Per-phase concurrency controller: a phase runs in rounds, the first few
+ * probe parallel degrees by measured throughput, the rest run at the best.
+ *
+ */
+
+#ifndef TUNE_H
+#define TUNE_H
+
+#include <stdio.h>
+
+/* Probe rounds each take this share of the phase (at least one item per thread),
+ * and together at most half of it. */
+#define TUNE_SLICES 16
+
+/* A degree must beat the best one by this much to be kept. */
+#define TUNE_GAIN 0.1
+
+/* Type definitions. */
+typedef struct                    // Type of the controller of one phase.
+  {
+    const char *name;
+    unsigned int fixed;             // Degree forced by an override, 0 for adaptive.
+    unsigned int max;               // Largest degree tried.
+    unsigned int degree;            // Degree of the current round.
+    unsigned int first;             // Degree of the first round.
+    unsigned int best;              // Best degree measured, kept across phases.
+    double best_rate;               // Its work per second.
+    int step;                       // 1 doubling, -1 halving, 0 settled.
+    unsigned int probes;            // Degrees measured.
+    double start;                   // Start of the current round.
+    double work, secs;              // Totals of the phase.
+  } tune_phase;
+
+/* Set up a phase: adaptive between 1 and MAX, starting from START (or from the
+ * best degree of an earlier run of the phase), unless FIXED overrides it. */
+void initTune (tune_phase *tp, const char *name, unsigned int start, unsigned int max,
+               unsigned int fixed);
+
+/* Begin a round with LEFT of TOTAL items left; returns the items it takes, to
+ * be run with tp->degree threads. Phases not cut into rounds pass 1 of 1 and
+ * run at the starting degree. */
+long unsigned int tuneBegin (tune_phase *tp, long unsigned int left, long unsigned int total);
+
+/* End a round that did WORK (bytes, entries...), adjusting the degree. */
+void tuneEnd (tune_phase *tp, double work);
+
+/* Print what a phase chose, e.g. "read 4 (probed 3, 812.4 MB/s)". */
+void tuneReport (const tune_phase *tp, FILE *file);
+
+#endif